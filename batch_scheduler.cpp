@@ -0,0 +1,45 @@
+#include "batch_scheduler.h"
+#include <algorithm>
+#include <iterator>
+
+void BatchScheduler::add(int tag, const cv::Mat &image) {
+  int sequence = this->added++;
+  // In order, a job may only join the newest group
+  size_t first =
+      this->keepOrder && !this->open.empty() ? this->open.size() - 1 : 0;
+  for (size_t i = first; i < this->open.size(); i++) {
+    Batch &batch = this->open[i];
+    if (batch.width == image.cols && batch.height == image.rows) {
+      batch.jobs.push_back({tag, image, sequence});
+      return;
+    }
+  }
+  Batch batch;
+  batch.width = image.cols;
+  batch.height = image.rows;
+  batch.jobs.push_back({tag, image, sequence});
+  this->open.push_back(std::move(batch));
+}
+
+bool BatchScheduler::next(Batch &out, bool flush) {
+  for (size_t i = 0; i < this->open.size(); i++) {
+    Batch &batch = this->open[i];
+    bool superseded = this->keepOrder && i + 1 < this->open.size();
+    bool stale = this->maxAge > 0 &&
+                 this->added - batch.jobs.front().sequence > this->maxAge;
+    if (!flush && !superseded && !stale &&
+        (int)batch.jobs.size() < this->maxLayers)
+      continue;
+    out.width = batch.width;
+    out.height = batch.height;
+    // Anything past maxLayers stays queued for the next batch
+    size_t count = std::min(batch.jobs.size(), (size_t)this->maxLayers);
+    out.jobs.assign(std::make_move_iterator(batch.jobs.begin()),
+                    std::make_move_iterator(batch.jobs.begin() + count));
+    batch.jobs.erase(batch.jobs.begin(), batch.jobs.begin() + count);
+    if (batch.jobs.empty())
+      this->open.erase(this->open.begin() + i);
+    return true;
+  }
+  return false;
+}
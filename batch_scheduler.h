@@ -0,0 +1,39 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+struct BatchJob {
+  int tag; // Caller-defined id (input index...)
+  cv::Mat image;
+  int sequence = 0; // Position in arrival order, set by add()
+};
+
+// Same-sized jobs for one run of a layered Pipeline: jobs[i] goes in layer i
+struct Batch {
+  int width = 0, height = 0;
+  std::vector<BatchJob> jobs;
+};
+
+// Groups incoming still images by resolution, so each batch fills the layers
+// of one texture array. A group is handed out as soon as it holds maxLayers
+// jobs, or once maxAge more jobs have arrived since its oldest one: that
+// bounds how many decoded images wait when sizes rarely repeat. The rest
+// wait for a flush. Jobs of one size keep their order, but sizes can
+// overtake each other unless keepOrder is set: then only runs of
+// consecutive same-sized jobs are grouped, and a new size releases the run
+// before it
+struct BatchScheduler {
+  int maxLayers = 4;
+  int maxAge = 0; // 0 keeps partial groups until a flush
+  bool keepOrder = false;
+
+  void add(int tag, const cv::Mat &image);
+  // Takes a full batch or, with flush, the oldest partial one. False if
+  // there is none
+  bool next(Batch &out, bool flush);
+  bool empty() const { return this->open.empty(); }
+
+private:
+  std::vector<Batch> open; // One per resolution, oldest first
+  int added = 0;
+};
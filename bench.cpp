@@ -0,0 +1,821 @@
+#include <glad/gl.h>
+#include <opencv2/opencv.hpp>
+#include "cpu_engine.h"
+#include "frame_upload.h"
+#include "gl_ext.h"
+#include "headless_context.h"
+#include "pipeline.h"
+#include "profiler.h"
+#include "readback.h"
+#include "shader_cache.h"
+#include "shader_utils.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// atsuki_bench: renders synthetic inputs through the headless pipeline and
+// reports throughput per configuration. Results go to a JSON file that a
+// later run can be compared against to catch regressions. --verify instead
+// diffs the GL passes against the CPU engine.
+
+struct BenchOptions {
+  std::string shaderDir;
+  std::string outPath = "bench_results.json";
+  std::string comparePath; // Baseline JSON; empty means no comparison
+  double tolerance = 0.10; // Allowed Mpix/s drop before flagging
+  int frames = 10;         // Timed frames per run, after the warm-up
+  int warmup = 2;
+  bool quick = false;    // Up to 1080p, fewer frames: for CI
+  bool software = false; // Force Mesa llvmpipe
+  bool verify = false;   // Pixel-diff GL against the CPU engine, no timing
+  std::string histogram; // --verify path: "compute", "fragment" or both
+  int threads = 0;       // CPU engine workers, 0 = all hardware threads
+  std::vector<std::string> resolutions; // Empty means all (or quick set)
+};
+
+struct Resolution {
+  const char *name;
+  int width, height;
+};
+static const Resolution kResolutions[] = {
+    {"480p", 854, 480},   {"720p", 1280, 720},  {"1080p", 1920, 1080},
+    {"1440p", 2560, 1440}, {"4k", 3840, 2160}, {"8k", 7680, 4320},
+};
+
+enum class Pattern { Noise, Gradient, Edges };
+static const char *patternName(Pattern p) {
+  switch (p) {
+  case Pattern::Noise:
+    return "noise";
+  case Pattern::Gradient:
+    return "gradient";
+  default:
+    return "edges";
+  }
+}
+
+struct Variant {
+  bool compute;
+  PixelFormat format;
+  const char *name;
+  bool cpu = false;  // CpuEngine instead of the GL pipeline
+  bool grid = false; // Read back the colour grid instead of the composite
+  bool temporal = false; // --temporal: only changed cells are recomputed
+  int layers = 1;        // --batch: frames rendered per run, one per layer
+};
+
+struct BenchRun {
+  std::string name;
+  int width = 0, height = 0;
+  int frames = 0;
+  double seconds = 0.0;
+  double fps = 0.0;
+  double mpixPerSecond = 0.0;
+  std::vector<StageReport> stages; // GPU passes, or CPU stages for "cpu"
+};
+
+static void printBenchUsage(const char *argv0) {
+  std::cerr
+      << "Usage: " << argv0 << " <shader_dir> [options]\n"
+      << "Options:\n"
+      << "  -o, --output <file>   Results JSON (default: bench_results.json)\n"
+      << "  --compare <file>      Baseline JSON to check for regressions\n"
+      << "  --tolerance <frac>    Allowed Mpix/s drop (default: 0.10)\n"
+      << "  --frames <n>          Timed frames per run (default: 10)\n"
+      << "  --resolutions <list>  Comma-separated subset of 480p,720p,1080p,\n"
+      << "                        1440p,4k,8k (default: all)\n"
+      << "  --quick               480p-1080p, 5 frames per run\n"
+      << "  --software            Force Mesa llvmpipe (no GPU needed)\n"
+      << "  --threads <n>         CPU engine threads (default: all cores)\n"
+      << "  --verify              Diff the GL passes against the CPU engine\n"
+      << "                        instead of timing (default: 480p-1080p)\n"
+      << "  --histogram <path>    With --verify, only check the compute or\n"
+      << "                        fragment histogram (default: both)\n"
+      << "Exits with status 2 when --compare finds a regression or --verify\n"
+      << "finds a mismatch, and 1 on any other error (such as an unreadable\n"
+      << "baseline)\n";
+}
+
+static bool parseBenchOptions(int argc, char **argv, BenchOptions &opts) {
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    auto value = [&](const char *flag) -> const char * {
+      if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << flag << std::endl;
+        return nullptr;
+      }
+      return argv[++i];
+    };
+
+    if (std::strcmp(arg, "--quick") == 0) {
+      opts.quick = true;
+    } else if (std::strcmp(arg, "--software") == 0) {
+      opts.software = true;
+    } else if (std::strcmp(arg, "--verify") == 0) {
+      opts.verify = true;
+    } else if (std::strcmp(arg, "--histogram") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      opts.histogram = v;
+      if (opts.histogram != "compute" && opts.histogram != "fragment") {
+        std::cerr << "--histogram must be compute or fragment" << std::endl;
+        return false;
+      }
+    } else if (std::strcmp(arg, "--threads") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      opts.threads = std::atoi(v);
+      if (opts.threads <= 0) {
+        std::cerr << "--threads must be positive" << std::endl;
+        return false;
+      }
+    } else if (std::strcmp(arg, "-o") == 0 ||
+               std::strcmp(arg, "--output") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      opts.outPath = v;
+    } else if (std::strcmp(arg, "--compare") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      opts.comparePath = v;
+    } else if (std::strcmp(arg, "--tolerance") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      opts.tolerance = std::atof(v);
+      if (opts.tolerance < 0) {
+        std::cerr << "--tolerance must not be negative" << std::endl;
+        return false;
+      }
+    } else if (std::strcmp(arg, "--frames") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      opts.frames = std::atoi(v);
+      if (opts.frames <= 0) {
+        std::cerr << "--frames must be positive" << std::endl;
+        return false;
+      }
+    } else if (std::strcmp(arg, "--resolutions") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      std::stringstream list(v);
+      std::string name;
+      while (std::getline(list, name, ','))
+        opts.resolutions.push_back(name);
+    } else if (arg[0] == '-' && arg[1] != '\0') {
+      std::cerr << "Unknown option: " << arg << std::endl;
+      return false;
+    } else {
+      positional.push_back(arg);
+    }
+  }
+  if (positional.size() != 1)
+    return false;
+  opts.shaderDir = positional[0];
+
+  if (opts.quick || opts.verify) {
+    if (opts.resolutions.empty())
+      opts.resolutions = {"480p", "720p", "1080p"};
+    opts.frames = std::min(opts.frames, 5);
+  }
+  for (const std::string &name : opts.resolutions) {
+    bool known = false;
+    for (const Resolution &r : kResolutions)
+      known |= name == r.name;
+    if (!known) {
+      std::cerr << "Unknown resolution: " << name << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Deterministic inputs, so runs are comparable across machines and builds.
+// Edges are stripes at 0, 45, 90 and 135 degrees, one angle per quadrant
+static cv::Mat makeInput(Pattern pattern, int w, int h) {
+  cv::Mat image(h, w, CV_8UC3);
+  uint32_t state = 0x9e3779b9u;
+  for (int y = 0; y < h; y++) {
+    uint8_t *row = image.ptr(y);
+    for (int x = 0; x < w; x++) {
+      uint8_t *px = row + x * 3;
+      if (pattern == Pattern::Noise) {
+        // xorshift32
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        px[0] = state & 0xff;
+        px[1] = (state >> 8) & 0xff;
+        px[2] = (state >> 16) & 0xff;
+      } else if (pattern == Pattern::Gradient) {
+        float dx = (x - w * 0.5f) / w, dy = (y - h * 0.5f) / h;
+        px[0] = (uint8_t)(255 * x / std::max(1, w - 1));
+        px[1] = (uint8_t)(255 * y / std::max(1, h - 1));
+        float radius = std::sqrt(dx * dx + dy * dy);
+        px[2] = (uint8_t)std::min(255.0f, 360.0f * radius);
+      } else {
+        static const float angles[] = {0.0f, 45.0f, 90.0f, 135.0f};
+        int quadrant = (y >= h / 2) * 2 + (x >= w / 2);
+        float a = angles[quadrant] * 3.14159265f / 180.0f;
+        float d = x * std::cos(a) + y * std::sin(a);
+        uint8_t v = ((int)std::floor(d / 8.0f) & 1) ? 255 : 0;
+        px[0] = px[1] = px[2] = v;
+      }
+    }
+  }
+  return image;
+}
+
+static std::string runName(const Resolution &res, Pattern pattern,
+                           const Variant &variant, int cols,
+                           float threshold) {
+  std::ostringstream name;
+  name << res.name << "/" << patternName(pattern) << "/" << variant.name
+       << "/cols" << cols << "/t" << std::fixed << std::setprecision(2)
+       << threshold;
+  return name.str();
+}
+
+// Upload, render and read back the same frame repeatedly, the way the
+// headless path processes a stream. Layered variants render the frame into
+// every layer; temporal ones measure change detection with nothing to
+// recompute after the first frame
+static BenchRun runOne(Pipeline &pipeline, const cv::Mat &bgr,
+                       const Variant &variant, int cols, float threshold,
+                       const BenchOptions &opts) {
+  int w = bgr.cols, h = bgr.rows;
+  if (pipeline.width != w || pipeline.height != h ||
+      pipeline.gridCols != cols)
+    pipeline.resize(w, h, cols);
+  pipeline.edgeParams.set(&EdgeParams::threshold, threshold);
+
+  FrameUploader uploader;
+  uploader.init(w, h, variant.format, 3, variant.layers);
+  cv::Mat frame = bgr;
+  if (variant.format == PixelFormat::NV12)
+    cv::cvtColor(bgr, frame, cv::COLOR_BGR2YUV_NV12);
+  for (int slot = 0; slot < uploader.slotCount(); slot++)
+    std::memcpy(uploader.slotData(slot), frame.data, uploader.frameBytes());
+  ReadbackRing readback;
+  readback.init(pipeline.output().width, pipeline.output().height, 3,
+                pipeline.readbackFormat());
+
+  cv::Mat result;
+  int tag;
+  auto renderFrame = [&](int index) {
+    int slot = index % uploader.slotCount();
+    uploader.slotFree(slot, true);
+    for (int layer = 0; layer < variant.layers; layer++)
+      uploader.upload(slot, layer);
+    pipeline.run(uploader);
+    RenderTarget out = pipeline.output();
+    for (int layer = 0; layer < variant.layers; layer++) {
+      if (readback.full())
+        readback.dequeue(result, tag, true);
+      if (variant.layers > 1)
+        readback.enqueueLayer(out.texture, layer, index);
+      else
+        readback.enqueue(out.fbo, index);
+    }
+    if (Profiler::active)
+      Profiler::active->endFrame();
+  };
+
+  for (int i = 0; i < opts.warmup; i++)
+    renderFrame(i);
+  while (readback.dequeue(result, tag, true)) {
+  }
+  glFinish();
+
+  Profiler profiler;
+  profiler.summaryInterval = 0;
+  Profiler::active = &profiler;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < opts.frames; i++)
+    renderFrame(opts.warmup + i);
+  while (readback.dequeue(result, tag, true)) {
+  }
+  glFinish();
+  BenchRun run;
+  run.seconds = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  Profiler::active = nullptr;
+
+  run.width = w;
+  run.height = h;
+  run.frames = opts.frames * variant.layers;
+  run.fps = run.frames / run.seconds;
+  run.mpixPerSecond = (double)w * h * run.frames / run.seconds / 1e6;
+  for (const StageReport &stage : profiler.report(true)) {
+    if (stage.gpu)
+      run.stages.push_back(stage);
+  }
+  return run;
+}
+
+static BenchRun runCpuOne(CpuEngine &engine, const cv::Mat &bgr, int cols,
+                          float threshold, const BenchOptions &opts) {
+  if (engine.width != bgr.cols || engine.height != bgr.rows ||
+      engine.gridCols != cols)
+    engine.resize(bgr.cols, bgr.rows, cols);
+  engine.edgeThreshold = threshold;
+
+  cv::Mat result;
+  for (int i = 0; i < opts.warmup; i++)
+    engine.run(bgr, result);
+
+  Profiler profiler;
+  profiler.summaryInterval = 0;
+  Profiler::active = &profiler;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < opts.frames; i++) {
+    engine.run(bgr, result);
+    profiler.endFrame();
+  }
+  BenchRun run;
+  run.seconds = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  Profiler::active = nullptr;
+
+  run.width = bgr.cols;
+  run.height = bgr.rows;
+  run.frames = opts.frames;
+  run.fps = run.frames / run.seconds;
+  run.mpixPerSecond = (double)run.width * run.height * run.frames /
+                      run.seconds / 1e6;
+  run.stages = profiler.report(true);
+  return run;
+}
+
+static void printRun(const BenchRun &run) {
+  std::cout << std::left << std::setw(44) << run.name << std::right
+            << std::fixed << std::setprecision(1) << std::setw(8) << run.fps
+            << " fps" << std::setw(9) << run.mpixPerSecond << " Mpix/s ";
+  std::cout << std::setprecision(2);
+  for (const StageReport &stage : run.stages)
+    std::cout << " " << stage.name << " " << stage.p50 << " ms";
+  std::cout << std::defaultfloat << std::endl;
+}
+
+// One run per line, which is what readBaseline relies on
+static bool writeResults(const std::string &path, const std::string &renderer,
+                         const BenchOptions &opts,
+                         const std::vector<BenchRun> &runs) {
+  std::ofstream file(path);
+  if (!file) {
+    std::cerr << "Failed to write " << path << std::endl;
+    return false;
+  }
+  file << "{\n  \"renderer\": \"" << renderer << "\",\n  \"frames\": "
+       << opts.frames << ",\n  \"runs\": [";
+  for (size_t i = 0; i < runs.size(); i++) {
+    const BenchRun &run = runs[i];
+    file << (i ? "," : "") << "\n    {\"name\": \"" << run.name
+         << "\", \"width\": " << run.width << ", \"height\": " << run.height
+         << ", \"fps\": " << run.fps
+         << ", \"mpix_per_s\": " << run.mpixPerSecond << ", \"p50_ms\": {";
+    for (size_t s = 0; s < run.stages.size(); s++) {
+      file << (s ? ", " : "") << "\"" << run.stages[s].name
+           << "\": " << run.stages[s].p50;
+    }
+    file << "}}";
+  }
+  file << "\n  ]\n}\n";
+  return (bool)file;
+}
+
+// Reads back files written by writeResults, not general JSON
+static std::string jsonField(const std::string &line, const char *key) {
+  std::string pattern = std::string("\"") + key + "\": ";
+  size_t pos = line.find(pattern);
+  if (pos == std::string::npos)
+    return "";
+  pos += pattern.size();
+  if (line[pos] == '"') {
+    size_t end = line.find('"', pos + 1);
+    return line.substr(pos + 1, end - pos - 1);
+  }
+  size_t end = line.find_first_of(",}", pos);
+  return line.substr(pos, end - pos);
+}
+
+static bool readBaseline(const std::string &path, std::string &renderer,
+                         std::map<std::string, double> &mpixPerSecond) {
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "Failed to open baseline " << path << std::endl;
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    std::string r = jsonField(line, "renderer");
+    if (!r.empty())
+      renderer = r;
+    std::string name = jsonField(line, "name");
+    std::string value = jsonField(line, "mpix_per_s");
+    if (!name.empty() && !value.empty())
+      mpixPerSecond[name] = std::atof(value.c_str());
+  }
+  return true;
+}
+
+// Returns the number of regressions, or -1 if the baseline can't be read
+static int compareRuns(const std::vector<BenchRun> &runs,
+                       const std::string &renderer,
+                       const BenchOptions &opts) {
+  std::string baseRenderer;
+  std::map<std::string, double> baseline;
+  if (!readBaseline(opts.comparePath, baseRenderer, baseline))
+    return -1;
+  if (baseline.empty()) {
+    std::cerr << "No runs in baseline " << opts.comparePath << std::endl;
+    return -1;
+  }
+  if (baseRenderer != renderer) {
+    std::cout << "Warning: baseline was recorded on \"" << baseRenderer
+              << "\"" << std::endl;
+  }
+
+  int regressions = 0, compared = 0;
+  std::cout << "Compared with " << opts.comparePath << " (tolerance "
+            << opts.tolerance * 100 << "%):" << std::endl;
+  for (const BenchRun &run : runs) {
+    auto it = baseline.find(run.name);
+    if (it == baseline.end() || it->second <= 0)
+      continue;
+    compared++;
+    double change = run.mpixPerSecond / it->second - 1.0;
+    if (change < -opts.tolerance) {
+      regressions++;
+      std::cout << "  REGRESSION " << run.name << ": " << std::fixed
+                << std::setprecision(1) << it->second << " -> "
+                << run.mpixPerSecond << " Mpix/s (" << change * 100 << "%)"
+                << std::defaultfloat << std::endl;
+    }
+  }
+  std::cout << "  " << compared << " run(s) compared, " << regressions
+            << " regression(s)" << std::endl;
+  return regressions;
+}
+
+// Share of edge pixels --verify lets differ. Edges differ only where float
+// rounding lands a pixel on the other side of the threshold or a sector
+// boundary. The later passes are checked on GL's own edges and must match
+// exactly
+static const double kEdgeMismatchLimit = 0.0001;
+
+// Direction code (0 = none, else bin + 1) of an R8 value the shaders wrote
+static uint8_t codeFromGray(uint8_t gray) {
+  if (gray == 0)
+    return 0;
+  uint8_t best = 1;
+  for (uint8_t code = 2; code <= 8; code++) {
+    if (std::abs(gray - CpuEngine::cellGray(code)) <
+        std::abs(gray - CpuEngine::cellGray(best)))
+      best = code;
+  }
+  return best;
+}
+
+// Rows bottom-up, as GL stores them
+static std::vector<uint8_t> readTarget(const RenderTarget &target,
+                                       GLenum format, int channels) {
+  std::vector<uint8_t> pixels((size_t)target.width * target.height *
+                              channels);
+  glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, target.width, target.height, format, GL_UNSIGNED_BYTE,
+               pixels.data());
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  return pixels;
+}
+
+// Renders bgr once through the GL pipeline and the CPU engine and diffs
+// the edge directions. The cells and the final composite are diffed against
+// the CPU histogram and composite of GL's edges, so a stray edge pixel can't
+// hide a histogram bug. Returns false on any cell or composite mismatch, or
+// too many edge mismatches
+static bool verifyOne(Pipeline &pipeline, CpuEngine &engine,
+                      const cv::Mat &bgr, int cols, float threshold,
+                      const std::string &name) {
+  int w = bgr.cols, h = bgr.rows;
+  if (pipeline.width != w || pipeline.height != h ||
+      pipeline.gridCols != cols)
+    pipeline.resize(w, h, cols);
+  pipeline.edgeParams.set(&EdgeParams::threshold, threshold);
+  FrameUploader uploader;
+  uploader.init(w, h, PixelFormat::BGR, 1);
+  uploader.uploadImage(bgr);
+  pipeline.run(uploader);
+
+  if (engine.width != w || engine.height != h || engine.gridCols != cols)
+    engine.resize(w, h, cols);
+  engine.edgeThreshold = threshold;
+  cv::Mat cpuComposite;
+  engine.run(bgr, cpuComposite);
+
+  // Edges: GL row y holds image row h - 1 - y. Replace the CPU's edges with
+  // GL's for the passes after
+  std::vector<uint8_t> glEdges =
+      readTarget(pipeline.graph.target(pipeline.edges), GL_RED, 1);
+  size_t edgeMismatches = 0;
+  for (int y = 0; y < h; y++) {
+    const uint8_t *gl = &glEdges[(size_t)y * w];
+    uint8_t *cpu = &engine.edges[(size_t)(h - 1 - y) * w];
+    for (int x = 0; x < w; x++) {
+      uint8_t code = codeFromGray(gl[x]);
+      edgeMismatches += code != cpu[x];
+      cpu[x] = code;
+    }
+  }
+  engine.runFromEdges(cpuComposite);
+
+  std::vector<uint8_t> glCells =
+      readTarget(pipeline.graph.target(pipeline.cells), GL_RED, 1);
+  size_t cellMismatches = 0;
+  for (size_t i = 0; i < glCells.size(); i++)
+    cellMismatches += codeFromGray(glCells[i]) != engine.cells[i];
+
+  // The composite is written top-down, so row order matches the CPU output.
+  // R8 conversions may round differently by one level, and a pixel exactly
+  // on a cell boundary may sample the cell on either side: it has to match
+  // the CPU at itself or a neighbouring pixel
+  std::vector<uint8_t> glComposite =
+      readTarget(pipeline.output(), GL_RGBA, 4);
+  auto near = [&](uint8_t value, int x, int y) {
+    x = std::min(std::max(x, 0), w - 1);
+    y = std::min(std::max(y, 0), h - 1);
+    return std::abs(value - cpuComposite.ptr(y)[x * 3]) <= 1;
+  };
+  size_t compositeMismatches = 0;
+  for (int y = 0; y < h; y++) {
+    const uint8_t *gl = &glComposite[(size_t)y * w * 4];
+    for (int x = 0; x < w; x++) {
+      uint8_t v = gl[x * 4];
+      compositeMismatches += !near(v, x, y) && !near(v, x - 1, y) &&
+                             !near(v, x + 1, y) && !near(v, x, y - 1) &&
+                             !near(v, x, y + 1);
+    }
+  }
+
+  double edgeShare = (double)edgeMismatches / ((double)w * h);
+  bool ok = edgeShare <= kEdgeMismatchLimit && cellMismatches == 0 &&
+            compositeMismatches == 0;
+  std::cout << std::left << std::setw(44) << name << std::right << std::fixed
+            << std::setprecision(4) << " edges " << edgeShare * 100
+            << "%  cells " << cellMismatches << "  composite "
+            << compositeMismatches << (ok ? "" : "  FAIL")
+            << std::defaultfloat << std::endl;
+  return ok;
+}
+
+// Every kernel the CPU supports must agree with the scalar one exactly
+static bool verifyKernels(const cv::Mat &bgr, int cols, float threshold,
+                          const std::string &name) {
+  CpuEngine reference;
+  reference.init(bgr.cols, bgr.rows, cols, 1, CpuKernel::Scalar);
+  reference.edgeThreshold = threshold;
+  cv::Mat expected, result;
+  reference.run(bgr, expected);
+
+  bool ok = true;
+  for (CpuKernel kernel : {CpuKernel::Sse41, CpuKernel::Avx2}) {
+    CpuEngine engine;
+    engine.init(bgr.cols, bgr.rows, cols, 0, kernel);
+    if (engine.kernel != kernel)
+      continue; // Not supported here
+    engine.edgeThreshold = threshold;
+    engine.run(bgr, result);
+    bool same =
+        engine.edges == reference.edges && engine.cells == reference.cells;
+    for (int y = 0; same && y < result.rows; y++)
+      same = std::memcmp(result.ptr(y), expected.ptr(y), result.cols * 3) == 0;
+    if (!same) {
+      std::cout << name << ": " << cpuKernelName(kernel)
+                << " differs from scalar  FAIL" << std::endl;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+// Returns the number of failed comparisons, or -1 if the requested path
+// can't run here
+static int runVerify(const BenchOptions &opts,
+                     const std::vector<Resolution> &resolutions) {
+  const Pattern patterns[] = {Pattern::Noise, Pattern::Gradient,
+                              Pattern::Edges};
+  const int gridSweep[] = {40, 160, 320};
+  const float thresholdSweep[] = {0.05f, 0.2f, 0.8f};
+
+  std::vector<bool> computeModes;
+  if (opts.histogram != "fragment") {
+    if (glCaps.computeShaders)
+      computeModes.push_back(true);
+    else if (opts.histogram == "compute") {
+      std::cerr << "Compute shaders are not supported here" << std::endl;
+      return -1;
+    }
+  }
+  if (opts.histogram != "compute")
+    computeModes.push_back(false);
+
+  int failures = 0, cases = 0;
+  for (bool compute : computeModes) {
+    Pipeline pipeline;
+    pipeline.init(resolutions[0].width, resolutions[0].height, 160,
+                  opts.shaderDir, compute, PipelineOutput::Composite);
+    // Keep the intermediate targets alive past execute() to read them back
+    pipeline.graph.markOutput(pipeline.edges);
+    pipeline.graph.markOutput(pipeline.cells);
+    pipeline.graph.compile();
+    CpuEngine engine;
+    engine.init(resolutions[0].width, resolutions[0].height, 160,
+                opts.threads);
+
+    Variant variant = {compute, PixelFormat::BGR,
+                       compute ? "compute-bgr" : "fragment-bgr"};
+    for (const Resolution &res : resolutions) {
+      for (Pattern pattern : patterns) {
+        cv::Mat input = makeInput(pattern, res.width, res.height);
+        for (int cols : gridSweep) {
+          for (float threshold : thresholdSweep) {
+            std::string name = runName(res, pattern, variant, cols, threshold);
+            failures += !verifyOne(pipeline, engine, input, cols, threshold,
+                                   name);
+            // Kernels don't depend on the GL path; check them once
+            if (compute == computeModes[0])
+              failures += !verifyKernels(input, cols, threshold, name);
+            cases++;
+          }
+        }
+      }
+    }
+  }
+  std::cout << cases << " case(s) verified, " << failures << " failure(s)"
+            << std::endl;
+  return failures;
+}
+
+int main(int argc, char **argv) {
+  BenchOptions opts;
+  if (!parseBenchOptions(argc, argv, opts)) {
+    printBenchUsage(argv[0]);
+    return 1;
+  }
+  if (opts.software) {
+    setenv("LIBGL_ALWAYS_SOFTWARE", "1", 1);
+    setenv("GALLIUM_DRIVER", "llvmpipe", 1);
+  }
+
+  HeadlessContext context;
+  if (!context.init())
+    return 1;
+  int glVersion = gladLoadGL(headlessGetProcAddress);
+  if (!glVersion) {
+    std::cerr << "Failed to initialize GLAD" << std::endl;
+    return 1;
+  }
+  loadGLExtensions(headlessGetProcAddress, glVersion);
+  std::string renderer = (const char *)glGetString(GL_RENDERER);
+  std::cout << "Renderer: " << renderer << std::endl;
+  ShaderCache cache;
+  cache.init(ShaderCache::defaultDirectory());
+  if (cache.enabled)
+    ShaderProgram::cache = &cache;
+
+  std::vector<Resolution> resolutions;
+  for (const Resolution &r : kResolutions) {
+    bool selected = opts.resolutions.empty();
+    for (const std::string &name : opts.resolutions)
+      selected |= name == r.name;
+    if (selected)
+      resolutions.push_back(r);
+  }
+  // Grid and threshold sweeps run at one mid-size resolution
+  Resolution sweepRes = resolutions[0];
+  for (const Resolution &r : resolutions) {
+    if (r.height <= 1080)
+      sweepRes = r;
+  }
+
+  if (opts.verify) {
+    int failures = runVerify(opts, resolutions);
+    ShaderProgram::cache = nullptr;
+    if (failures < 0)
+      return 1;
+    return failures ? 2 : 0;
+  }
+
+  std::vector<Variant> variants;
+  if (glCaps.computeShaders) {
+    variants.push_back({true, PixelFormat::BGR, "compute-bgr"});
+    variants.push_back({true, PixelFormat::NV12, "compute-nv12"});
+  }
+  variants.push_back({false, PixelFormat::BGR, "fragment-bgr"});
+  variants.push_back({false, PixelFormat::NV12, "fragment-nv12"});
+  variants.push_back({glCaps.computeShaders, PixelFormat::BGR, "grid-bgr",
+                      false, true});
+  // Shader variants: cell_quad.vert and the TEMPORAL histogram, and the
+  // LAYERED passes of --batch
+  if (glCaps.computeShaders) {
+    variants.push_back(
+        {true, PixelFormat::BGR, "compute-temporal", false, false, true});
+    variants.push_back(
+        {true, PixelFormat::BGR, "compute-batch4", false, false, false, 4});
+  }
+  variants.push_back(
+      {false, PixelFormat::BGR, "fragment-temporal", false, false, true});
+  variants.push_back(
+      {false, PixelFormat::BGR, "fragment-batch4", false, false, false, 4});
+  variants.push_back({false, PixelFormat::BGR, "cpu", true});
+
+  const Pattern patterns[] = {Pattern::Noise, Pattern::Gradient,
+                              Pattern::Edges};
+  const int gridSweep[] = {40, 80, 320, 640};
+  const float thresholdSweep[] = {0.05f, 0.1f, 0.4f, 0.8f};
+  const int defaultCols = 160;
+  const float defaultThreshold = 0.2f;
+
+  std::vector<BenchRun> runs;
+  for (const Variant &variant : variants) {
+    std::unique_ptr<Pipeline> pipeline;
+    std::unique_ptr<CpuEngine> engine;
+    if (variant.cpu) {
+      engine = std::make_unique<CpuEngine>();
+      engine->init(resolutions[0].width, resolutions[0].height, defaultCols,
+                   opts.threads);
+    } else {
+      pipeline = std::make_unique<Pipeline>();
+      pipeline->temporal = variant.temporal;
+      pipeline->layers = variant.layers;
+      pipeline->init(resolutions[0].width, resolutions[0].height,
+                     defaultCols, opts.shaderDir, variant.compute,
+                     variant.grid ? PipelineOutput::ColorGrid
+                                  : PipelineOutput::Composite);
+    }
+    auto record = [&](const Resolution &res, Pattern pattern, int cols,
+                      float threshold, const cv::Mat &input) {
+      BenchRun run =
+          variant.cpu
+              ? runCpuOne(*engine, input, cols, threshold, opts)
+              : runOne(*pipeline, input, variant, cols, threshold, opts);
+      run.name = runName(res, pattern, variant, cols, threshold);
+      printRun(run);
+      runs.push_back(run);
+    };
+
+    for (const Resolution &res : resolutions) {
+      for (Pattern pattern : patterns) {
+        cv::Mat input = makeInput(pattern, res.width, res.height);
+        record(res, pattern, defaultCols, defaultThreshold, input);
+      }
+    }
+    // The sweeps only change how the pipeline is configured, so one input
+    // format and mode is enough
+    if (variant.format != PixelFormat::BGR || variant.temporal ||
+        variant.layers > 1)
+      continue;
+    cv::Mat edges = makeInput(Pattern::Edges, sweepRes.width, sweepRes.height);
+    for (int cols : gridSweep)
+      record(sweepRes, Pattern::Edges, cols, defaultThreshold, edges);
+    for (float threshold : thresholdSweep)
+      record(sweepRes, Pattern::Edges, defaultCols, threshold, edges);
+  }
+  cache.printStats();
+  ShaderProgram::cache = nullptr;
+
+  if (!writeResults(opts.outPath, renderer, opts, runs))
+    return 1;
+  std::cout << "Wrote " << runs.size() << " run(s) to " << opts.outPath
+            << std::endl;
+
+  if (!opts.comparePath.empty()) {
+    int regressions = compareRuns(runs, renderer, opts);
+    if (regressions < 0)
+      return 1;
+    if (regressions != 0)
+      return 2;
+  }
+  return 0;
+}
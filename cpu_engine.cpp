@@ -0,0 +1,568 @@
+#include "cpu_engine.h"
+#include "pipeline.h"
+#include "profiler.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ATSUKI_X86 1
+#include <immintrin.h>
+#endif
+
+// Rows per task. Each band re-filters the two rows around it, so larger
+// bands waste less work; smaller ones balance better across threads
+static const int kBandRows = 32;
+
+// Sector boundaries of edge_detect.frag's 8-way quantization, as slopes
+static const float kTan22 = 0.41421356f; // tan(22.5 degrees)
+static const float kTan67 = 2.41421356f; // tan(67.5 degrees)
+
+// edge_detect.frag's output value per direction bin
+static const float kBinValues[8] = {0.1f, 0.2f, 0.3f, 0.4f,
+                                    0.5f, 0.7f, 0.8f, 0.9f};
+
+const char *cpuKernelName(CpuKernel kernel) {
+  switch (kernel) {
+  case CpuKernel::Avx2:
+    return "avx2";
+  case CpuKernel::Sse41:
+    return "sse4.1";
+  case CpuKernel::Scalar:
+    return "scalar";
+  default:
+    return "auto";
+  }
+}
+
+static bool kernelSupported(CpuKernel kernel) {
+#ifdef ATSUKI_X86
+  if (kernel == CpuKernel::Avx2)
+    return __builtin_cpu_supports("avx2");
+  if (kernel == CpuKernel::Sse41)
+    return __builtin_cpu_supports("sse4.1");
+#endif
+  return kernel == CpuKernel::Scalar;
+}
+
+uint8_t CpuEngine::cellGray(uint8_t cell) {
+  return cell ? (uint8_t)(kBinValues[cell - 1] * 255.0f + 0.5f) : 0;
+}
+
+// Source rows of the 3x3 neighbourhood, already filtered horizontally. The
+// vertical gradient (edge_detect.frag's "sobelX") is smooth above minus
+// smooth below; the horizontal one ("sobelY") is diff above + 2 diff at the
+// row + diff below
+struct KernelRows {
+  const int16_t *smoothAbove[3], *smoothBelow[3];
+  const int16_t *diffAbove[3], *diffRow[3], *diffBelow[3];
+};
+
+// Direction bin of the red channel's gradient. a is the horizontal
+// component and b the vertical one, the shader's atan(sobelY, sobelX)
+static inline int sectorOf(int a, int b) {
+  float fa = (float)std::abs(a), fb = (float)std::abs(b);
+  if (fa <= kTan22 * fb) // Within 22.5 degrees of the b axis
+    return b >= 0 ? 0 : 4;
+  if (fa > kTan67 * fb) // Within 22.5 degrees of the a axis
+    return a > 0 ? 2 : 6;
+  if (a > 0)
+    return b > 0 ? 1 : 3;
+  return b < 0 ? 5 : 7;
+}
+
+// limit: squared gradient magnitude (in 8-bit units, summed over channels)
+// the shader's intensity threshold corresponds to
+static void classifyScalar(const KernelRows &k, int x0, int x1, int limit,
+                           uint8_t *out) {
+  for (int x = x0; x < x1; x++) {
+    int sum = 0, a = 0, b = 0;
+    for (int c = 0; c < 3; c++) {
+      int sx = k.smoothAbove[c][x] - k.smoothBelow[c][x];
+      int sy = k.diffAbove[c][x] + 2 * k.diffRow[c][x] + k.diffBelow[c][x];
+      sum += sx * sx + sy * sy;
+      if (c == 2) { // BGR: red last
+        a = sy;
+        b = sx;
+      }
+    }
+    out[x] = sum > limit ? (uint8_t)(sectorOf(a, b) + 1) : 0;
+  }
+}
+
+#ifdef ATSUKI_X86
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+static inline __m128i sectorsSse41(__m128i a, __m128i b) {
+  const __m128 signMask = _mm_set1_ps(-0.0f);
+  __m128 fa = _mm_andnot_ps(signMask, _mm_cvtepi32_ps(a));
+  __m128 fb = _mm_andnot_ps(signMask, _mm_cvtepi32_ps(b));
+  __m128i axisB = _mm_castps_si128(
+      _mm_cmple_ps(fa, _mm_mul_ps(_mm_set1_ps(kTan22), fb)));
+  __m128i axisA = _mm_castps_si128(
+      _mm_cmpgt_ps(fa, _mm_mul_ps(_mm_set1_ps(kTan67), fb)));
+  __m128i zero = _mm_setzero_si128();
+  __m128i aPos = _mm_cmpgt_epi32(a, zero);
+  __m128i bPos = _mm_cmpgt_epi32(b, zero);
+  __m128i bNeg = _mm_cmpgt_epi32(zero, b);
+
+  __m128i diagPos = _mm_blendv_epi8(_mm_set1_epi32(3), _mm_set1_epi32(1), bPos);
+  __m128i diagNeg = _mm_blendv_epi8(_mm_set1_epi32(7), _mm_set1_epi32(5), bNeg);
+  __m128i sector = _mm_blendv_epi8(diagNeg, diagPos, aPos);
+  sector = _mm_blendv_epi8(
+      sector, _mm_blendv_epi8(_mm_set1_epi32(6), _mm_set1_epi32(2), aPos),
+      axisA);
+  return _mm_blendv_epi8(
+      sector, _mm_blendv_epi8(_mm_setzero_si128(), _mm_set1_epi32(4), bNeg),
+      axisB);
+}
+
+// 8 pixels per iteration; returns where the scalar tail should start
+static int classifySse41(const KernelRows &k, int x0, int x1, int limit,
+                         uint8_t *out) {
+  const __m128i limitV = _mm_set1_epi32(limit);
+  const __m128i one = _mm_set1_epi32(1);
+  int x = x0;
+  for (; x + 8 <= x1; x += 8) {
+    __m128i sumLo = _mm_setzero_si128(), sumHi = _mm_setzero_si128();
+    __m128i a = sumLo, b = sumLo;
+    for (int c = 0; c < 3; c++) {
+      auto load = [x](const int16_t *p) {
+        return _mm_loadu_si128((const __m128i *)(p + x));
+      };
+      __m128i sx = _mm_sub_epi16(load(k.smoothAbove[c]),
+                                 load(k.smoothBelow[c]));
+      __m128i sy = _mm_add_epi16(
+          _mm_add_epi16(load(k.diffAbove[c]), load(k.diffBelow[c])),
+          _mm_slli_epi16(load(k.diffRow[c]), 1));
+      // Interleaved (sx, sy) pairs: madd gives sx^2 + sy^2 per pixel
+      __m128i lo = _mm_unpacklo_epi16(sx, sy);
+      __m128i hi = _mm_unpackhi_epi16(sx, sy);
+      sumLo = _mm_add_epi32(sumLo, _mm_madd_epi16(lo, lo));
+      sumHi = _mm_add_epi32(sumHi, _mm_madd_epi16(hi, hi));
+      if (c == 2) {
+        a = sy;
+        b = sx;
+      }
+    }
+    __m128i codeLo = _mm_and_si128(
+        _mm_cmpgt_epi32(sumLo, limitV),
+        _mm_add_epi32(sectorsSse41(_mm_cvtepi16_epi32(a),
+                                   _mm_cvtepi16_epi32(b)),
+                      one));
+    __m128i codeHi = _mm_and_si128(
+        _mm_cmpgt_epi32(sumHi, limitV),
+        _mm_add_epi32(sectorsSse41(_mm_cvtepi16_epi32(_mm_srli_si128(a, 8)),
+                                   _mm_cvtepi16_epi32(_mm_srli_si128(b, 8))),
+                      one));
+    __m128i codes = _mm_packs_epi32(codeLo, codeHi);
+    _mm_storel_epi64((__m128i *)(out + x), _mm_packus_epi16(codes, codes));
+  }
+  return x;
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+static inline __m256i sectorsAvx2(__m256i a, __m256i b) {
+  const __m256 signMask = _mm256_set1_ps(-0.0f);
+  __m256 fa = _mm256_andnot_ps(signMask, _mm256_cvtepi32_ps(a));
+  __m256 fb = _mm256_andnot_ps(signMask, _mm256_cvtepi32_ps(b));
+  __m256i axisB = _mm256_castps_si256(_mm256_cmp_ps(
+      fa, _mm256_mul_ps(_mm256_set1_ps(kTan22), fb), _CMP_LE_OQ));
+  __m256i axisA = _mm256_castps_si256(_mm256_cmp_ps(
+      fa, _mm256_mul_ps(_mm256_set1_ps(kTan67), fb), _CMP_GT_OQ));
+  __m256i zero = _mm256_setzero_si256();
+  __m256i aPos = _mm256_cmpgt_epi32(a, zero);
+  __m256i bPos = _mm256_cmpgt_epi32(b, zero);
+  __m256i bNeg = _mm256_cmpgt_epi32(zero, b);
+
+  __m256i diagPos =
+      _mm256_blendv_epi8(_mm256_set1_epi32(3), _mm256_set1_epi32(1), bPos);
+  __m256i diagNeg =
+      _mm256_blendv_epi8(_mm256_set1_epi32(7), _mm256_set1_epi32(5), bNeg);
+  __m256i sector = _mm256_blendv_epi8(diagNeg, diagPos, aPos);
+  sector = _mm256_blendv_epi8(
+      sector,
+      _mm256_blendv_epi8(_mm256_set1_epi32(6), _mm256_set1_epi32(2), aPos),
+      axisA);
+  return _mm256_blendv_epi8(
+      sector, _mm256_blendv_epi8(zero, _mm256_set1_epi32(4), bNeg), axisB);
+}
+
+// 16 pixels per iteration. The 256-bit unpacks work within 128-bit lanes, so
+// the "lo" half holds pixels 0-3 and 8-11 and the "hi" half 4-7 and 12-15;
+// packs_epi32 puts them back in order
+static int classifyAvx2(const KernelRows &k, int x0, int x1, int limit,
+                        uint8_t *out) {
+  const __m256i limitV = _mm256_set1_epi32(limit);
+  const __m256i one = _mm256_set1_epi32(1);
+  int x = x0;
+  for (; x + 16 <= x1; x += 16) {
+    __m256i sumLo = _mm256_setzero_si256(), sumHi = _mm256_setzero_si256();
+    __m256i a = sumLo, b = sumLo;
+    for (int c = 0; c < 3; c++) {
+      auto load = [x](const int16_t *p) {
+        return _mm256_loadu_si256((const __m256i *)(p + x));
+      };
+      __m256i sx = _mm256_sub_epi16(load(k.smoothAbove[c]),
+                                    load(k.smoothBelow[c]));
+      __m256i sy = _mm256_add_epi16(
+          _mm256_add_epi16(load(k.diffAbove[c]), load(k.diffBelow[c])),
+          _mm256_slli_epi16(load(k.diffRow[c]), 1));
+      __m256i lo = _mm256_unpacklo_epi16(sx, sy);
+      __m256i hi = _mm256_unpackhi_epi16(sx, sy);
+      sumLo = _mm256_add_epi32(sumLo, _mm256_madd_epi16(lo, lo));
+      sumHi = _mm256_add_epi32(sumHi, _mm256_madd_epi16(hi, hi));
+      if (c == 2) {
+        a = sy;
+        b = sx;
+      }
+    }
+    // Sign-extend the red gradients into the same lane order as the sums
+    __m256i aLo = _mm256_srai_epi32(_mm256_unpacklo_epi16(a, a), 16);
+    __m256i aHi = _mm256_srai_epi32(_mm256_unpackhi_epi16(a, a), 16);
+    __m256i bLo = _mm256_srai_epi32(_mm256_unpacklo_epi16(b, b), 16);
+    __m256i bHi = _mm256_srai_epi32(_mm256_unpackhi_epi16(b, b), 16);
+    __m256i codeLo =
+        _mm256_and_si256(_mm256_cmpgt_epi32(sumLo, limitV),
+                         _mm256_add_epi32(sectorsAvx2(aLo, bLo), one));
+    __m256i codeHi =
+        _mm256_and_si256(_mm256_cmpgt_epi32(sumHi, limitV),
+                         _mm256_add_epi32(sectorsAvx2(aHi, bHi), one));
+    __m256i codes = _mm256_packs_epi32(codeLo, codeHi);
+    codes = _mm256_packus_epi16(codes, codes);
+    // Bytes 0-7 and 16-23 hold the 16 results
+    codes = _mm256_permute4x64_epi64(codes, _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128((__m128i *)(out + x), _mm256_castsi256_si128(codes));
+  }
+  return x;
+}
+#pragma GCC pop_options
+#endif
+
+static void filterRow(const uint8_t *src, int w, int16_t *smooth[3],
+                      int16_t *diff[3]) {
+  for (int c = 0; c < 3; c++) {
+    int16_t *s = smooth[c], *d = diff[c];
+    // Clamp to edge, like the GL sampler
+    for (int x = 0; x < w; x++) {
+      int left = src[std::max(x - 1, 0) * 3 + c];
+      int right = src[std::min(x + 1, w - 1) * 3 + c];
+      s[x] = (int16_t)(left + 2 * src[x * 3 + c] + right);
+      d[x] = (int16_t)(right - left);
+    }
+  }
+}
+
+void CpuEngine::init(int w, int h, int cols, int threads,
+                     CpuKernel requested) {
+  this->pool = std::make_unique<ThreadPool>(threads);
+  this->scratch.assign(this->pool->size(), Scratch());
+
+  if (requested == CpuKernel::Auto) {
+    this->kernel = CpuKernel::Scalar;
+    for (CpuKernel k : {CpuKernel::Avx2, CpuKernel::Sse41}) {
+      if (kernelSupported(k)) {
+        this->kernel = k;
+        break;
+      }
+    }
+  } else if (kernelSupported(requested)) {
+    this->kernel = requested;
+  } else {
+    std::cerr << "CPU engine: " << cpuKernelName(requested)
+              << " not supported, using scalar" << std::endl;
+    this->kernel = CpuKernel::Scalar;
+  }
+  std::cout << "CPU engine: " << this->pool->size() << " thread(s), "
+            << cpuKernelName(this->kernel) << " kernel" << std::endl;
+  resize(w, h, cols);
+}
+
+void CpuEngine::resize(int w, int h, int cols) {
+  this->width = w;
+  this->height = h;
+  this->gridCols = cols;
+  this->gridRows = std::max(1, gridRowsFor(w, h, cols));
+  this->edges.assign((size_t)w * h, 0);
+  this->cells.assign((size_t)this->gridCols * this->gridRows, 0);
+  for (Scratch &s : this->scratch) {
+    for (RowFilter &row : s.rows) {
+      for (int c = 0; c < 3; c++) {
+        row.smooth[c].assign(w, 0);
+        row.diff[c].assign(w, 0);
+      }
+    }
+  }
+  // NEAREST sampling of the cells texture across the output, as in the
+  // composite pass
+  this->columnCell.resize(w);
+  for (int x = 0; x < w; x++)
+    this->columnCell[x] =
+        std::min(cols - 1, (int)((x + 0.5f) / w * (float)cols));
+}
+
+void CpuEngine::classifyRow(const RowFilter &above, const RowFilter &row,
+                            const RowFilter &below, uint8_t *out) const {
+  KernelRows k;
+  for (int c = 0; c < 3; c++) {
+    k.smoothAbove[c] = above.smooth[c].data();
+    k.smoothBelow[c] = below.smooth[c].data();
+    k.diffAbove[c] = above.diff[c].data();
+    k.diffRow[c] = row.diff[c].data();
+    k.diffBelow[c] = below.diff[c].data();
+  }
+  // intensity > threshold, with intensity = |gradient| / 255 / sqrt(3)
+  double limitD = 3.0 * 255.0 * 255.0 * this->edgeThreshold *
+                  this->edgeThreshold;
+  int limit = limitD >= INT_MAX ? INT_MAX : (int)std::floor(limitD);
+  if (this->edgeThreshold < 0)
+    limit = -1;
+
+  int x = 0;
+#ifdef ATSUKI_X86
+  if (this->kernel == CpuKernel::Avx2)
+    x = classifyAvx2(k, 0, this->width, limit, out);
+  else if (this->kernel == CpuKernel::Sse41)
+    x = classifySse41(k, 0, this->width, limit, out);
+#endif
+  classifyScalar(k, x, this->width, limit, out);
+}
+
+void CpuEngine::detectEdges(const cv::Mat &bgr, int band, int worker) {
+  int r0 = band * kBandRows;
+  int r1 = std::min(this->height, r0 + kBandRows);
+  Scratch &s = this->scratch[worker];
+
+  // Ring slot for row y, counting from the row above the band
+  auto slot = [&](int y) -> RowFilter & { return s.rows[(y - r0 + 1) % 3]; };
+  auto filter = [&](int y) {
+    int clamped = std::min(std::max(y, 0), this->height - 1);
+    RowFilter &f = slot(y);
+    int16_t *smooth[3] = {f.smooth[0].data(), f.smooth[1].data(),
+                          f.smooth[2].data()};
+    int16_t *diff[3] = {f.diff[0].data(), f.diff[1].data(), f.diff[2].data()};
+    filterRow(bgr.ptr(clamped), this->width, smooth, diff);
+  };
+
+  filter(r0 - 1);
+  filter(r0);
+  for (int y = r0; y < r1; y++) {
+    filter(y + 1);
+    classifyRow(slot(y - 1), slot(y), slot(y + 1),
+                this->edges.data() + (size_t)y * this->width);
+  }
+}
+
+// Cell rows count from the bottom, like the GL target: cell row cy covers
+// framebuffer rows [cy * cellHeight, (cy + 1) * cellHeight), which are image
+// rows height - 1 - that
+void CpuEngine::accumulateCells(int cy) {
+  int cols = this->gridCols;
+  int cellWidth = this->width / cols;
+  int cellHeight = this->height / this->gridRows;
+  std::vector<int> counts((size_t)cols * 9, 0);
+  for (int j = 0; j < cellHeight; j++) {
+    int y = this->height - 1 - (cy * cellHeight + j);
+    const uint8_t *row = this->edges.data() + (size_t)y * this->width;
+    for (int cx = 0; cx < cols; cx++) {
+      int *c = &counts[cx * 9];
+      const uint8_t *p = row + cx * cellWidth;
+      for (int i = 0; i < cellWidth; i++)
+        c[p[i]]++;
+    }
+  }
+
+  uint8_t *out = this->cells.data() + (size_t)cy * cols;
+  for (int cx = 0; cx < cols; cx++) {
+    const int *c = &counts[cx * 9];
+    int nonBlack = 0, highest = 0, best = 0;
+    for (int b = 1; b <= 8; b++) {
+      nonBlack += c[b];
+      // Strictly greater: ties go to the lowest bin, as in histogram.comp
+      // and histogram.frag
+      if (c[b] > highest) {
+        highest = c[b];
+        best = b;
+      }
+    }
+    out[cx] = best && nonBlack >= this->cellThreshold ? (uint8_t)best : 0;
+  }
+}
+
+void CpuEngine::analyze(const cv::Mat &bgr) {
+  if (bgr.cols != this->width || bgr.rows != this->height)
+    resize(bgr.cols, bgr.rows, this->gridCols);
+  int bands = (this->height + kBandRows - 1) / kBandRows;
+  {
+    ProfileSpan span("edges");
+    this->pool->parallelFor(bands, [&](int band, int worker) {
+      detectEdges(bgr, band, worker);
+    });
+  }
+  ProfileSpan span("histogram");
+  this->pool->parallelFor(this->gridRows,
+                          [&](int cy, int) { accumulateCells(cy); });
+}
+
+void CpuEngine::run(const cv::Mat &bgr, cv::Mat &out) {
+  analyze(bgr);
+  composite(out);
+}
+
+void CpuEngine::runFromEdges(cv::Mat &out) {
+  this->pool->parallelFor(this->gridRows,
+                          [&](int cy, int) { accumulateCells(cy); });
+  composite(out);
+}
+
+void CpuEngine::composite(cv::Mat &out) {
+  int w = this->width, h = this->height;
+  int bands = (h + kBandRows - 1) / kBandRows;
+
+  ProfileSpan span("composite");
+  out.create(h, w, CV_8UC3);
+  uint8_t gray[9];
+  for (int i = 0; i < 9; i++)
+    gray[i] = cellGray((uint8_t)i);
+  this->pool->parallelFor(bands, [&](int band, int) {
+    int r1 = std::min(h, (band + 1) * kBandRows);
+    for (int y = band * kBandRows; y < r1; y++) {
+      // The composite pass writes top-down: output row y samples the cells
+      // texture at v = 1 - (y + 0.5) / h
+      int cy = (int)((1.0f - (y + 0.5f) / h) * (float)this->gridRows);
+      cy = std::min(std::max(cy, 0), this->gridRows - 1);
+      const uint8_t *cellRow = this->cells.data() + (size_t)cy * gridCols;
+      uint8_t *dst = out.ptr(y);
+      for (int x = 0; x < w; x++) {
+        uint8_t v = gray[cellRow[this->columnCell[x]]];
+        dst[x * 3] = dst[x * 3 + 1] = dst[x * 3 + 2] = v;
+      }
+    }
+  });
+}
+
+// Bilinear sample of a BGR image at pixel coordinate (x, y), edges clamped
+// like GL_CLAMP_TO_EDGE
+static void sampleBilinear(const cv::Mat &bgr, float x, float y, float *out) {
+  x = std::min(std::max(x, 0.0f), (float)(bgr.cols - 1));
+  y = std::min(std::max(y, 0.0f), (float)(bgr.rows - 1));
+  int x0 = (int)x, y0 = (int)y;
+  int x1 = std::min(x0 + 1, bgr.cols - 1), y1 = std::min(y0 + 1, bgr.rows - 1);
+  float fx = x - x0, fy = y - y0;
+  const uint8_t *r0 = bgr.ptr(y0), *r1 = bgr.ptr(y1);
+  for (int c = 0; c < 3; c++) {
+    float top = r0[x0 * 3 + c] + (r0[x1 * 3 + c] - r0[x0 * 3 + c]) * fx;
+    float bottom = r1[x0 * 3 + c] + (r1[x1 * 3 + c] - r1[x0 * 3 + c]) * fx;
+    out[c] += top + (bottom - top) * fy;
+  }
+}
+
+void CpuEngine::packGridRow(const cv::Mat &bgr, int cy, cv::Mat &grid,
+                            bool color) const {
+  float cellWidth = (float)(this->width / this->gridCols);
+  float cellHeight = (float)(this->height / this->gridRows);
+  int levels = this->atlas.brightnessLevels;
+  uint8_t *out = grid.ptr(cy);
+  for (int cx = 0; cx < this->gridCols; cx++) {
+    // The 4x4 taps of grid_pack.frag. Cell row cy counts from the bottom;
+    // texel centres sit at half-pixel offsets
+    float mean[3] = {0.0f, 0.0f, 0.0f}; // B, G, R in 0..255
+    for (int i = 0; i < 4; i++) {
+      for (int j = 0; j < 4; j++) {
+        float px = (cx + (i + 0.5f) / 4.0f) * cellWidth;
+        float py = (cy + (j + 0.5f) / 4.0f) * cellHeight;
+        sampleBilinear(bgr, px - 0.5f, this->height - py - 0.5f, mean);
+      }
+    }
+    for (int c = 0; c < 3; c++)
+      mean[c] /= 16.0f;
+
+    uint8_t cell = this->cells[(size_t)cy * this->gridCols + cx];
+    int glyph;
+    if (cell) {
+      glyph = levels + cell - 1;
+    } else {
+      float brightness =
+          (0.299f * mean[2] + 0.587f * mean[1] + 0.114f * mean[0]) / 255.0f;
+      glyph = std::min((int)(brightness * levels), levels - 1);
+    }
+    if (color) {
+      out[cx * 4] = (uint8_t)glyph;
+      for (int c = 0; c < 3; c++)
+        out[cx * 4 + 1 + c] = (uint8_t)(mean[2 - c] + 0.5f);
+    } else {
+      out[cx] = (uint8_t)glyph;
+    }
+  }
+}
+
+bool CpuEngine::prepareAtlas() {
+  int cellW = std::max(1, this->width / this->gridCols);
+  int cellH = std::max(1, this->height / this->gridRows);
+  return this->atlas.prepare(this->glyphStyle, cellW, cellH);
+}
+
+void CpuEngine::runGrid(const cv::Mat &bgr, cv::Mat &grid, bool color) {
+  analyze(bgr);
+  if (!prepareAtlas()) {
+    grid = cv::Mat();
+    return;
+  }
+  ProfileSpan span("grid");
+  grid.create(this->gridRows, this->gridCols, color ? CV_8UC4 : CV_8UC1);
+  this->pool->parallelFor(this->gridRows, [&](int cy, int) {
+    packGridRow(bgr, cy, grid, color);
+  });
+}
+
+void CpuEngine::runAscii(const cv::Mat &bgr, cv::Mat &out) {
+  runGrid(bgr, this->colorGrid, true);
+  int w = this->width, h = this->height;
+  out.create(h, w, CV_8UC3);
+  if (this->colorGrid.empty()) {
+    out.setTo(cv::Scalar::all(0));
+    return;
+  }
+  ProfileSpan span("ascii");
+  int cellW = this->atlas.cellWidth, cellH = this->atlas.cellHeight;
+  int atlasWidth = this->atlas.width();
+  int bands = (h + kBandRows - 1) / kBandRows;
+  this->pool->parallelFor(bands, [&](int band, int) {
+    int r1 = std::min(h, (band + 1) * kBandRows);
+    for (int y = band * kBandRows; y < r1; y++) {
+      uint8_t *dst = out.ptr(y);
+      // Cells count from the bottom; rows above the last whole cell and
+      // columns right of it stay black, as in ascii_render.frag
+      int py = h - 1 - y;
+      int cy = py / cellH;
+      if (cy >= this->gridRows) {
+        std::memset(dst, 0, (size_t)w * 3);
+        continue;
+      }
+      int glyphRow = cellH - 1 - (py - cy * cellH); // Atlas rows top-first
+      const uint8_t *cells = this->colorGrid.ptr(cy);
+      for (int x = 0; x < w; x++) {
+        int cx = x / cellW;
+        if (cx >= this->gridCols) {
+          dst[x * 3] = dst[x * 3 + 1] = dst[x * 3 + 2] = 0;
+          continue;
+        }
+        const uint8_t *cell = cells + cx * 4;
+        int glyph = cell[0];
+        const uint8_t *texel =
+            this->atlas.pixels +
+            (size_t)((glyph / this->atlas.cols) * cellH + glyphRow) *
+                atlasWidth +
+            (glyph % this->atlas.cols) * cellW + (x - cx * cellW);
+        int coverage = *texel;
+        for (int c = 0; c < 3; c++)
+          dst[x * 3 + c] = (uint8_t)((cell[3 - c] * coverage + 127) / 255);
+      }
+    }
+  });
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "glyph_atlas.h"
+#include "thread_pool.h"
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Instruction set used for the Sobel/classification kernel
+enum class CpuKernel { Auto, Scalar, Sse41, Avx2 };
+const char *cpuKernelName(CpuKernel kernel);
+
+// CPU implementation of Pipeline with PipelineOutput::Composite, for
+// machines without usable GL and as the reference the shaders are checked
+// against. Reproduces edge_detect.frag (Sobel on the input, 8-way angle
+// quantization of the red channel's gradient), histogram.comp (dominant
+// direction per cell, ties to the lowest bin) and the composite pass,
+// including GL's orientation: cells are anchored at the bottom of the image.
+//
+// Frames are split into bands of rows spread over a thread pool.
+struct CpuEngine {
+  int width = 0, height = 0;
+  int gridCols = 0, gridRows = 0;
+  float edgeThreshold = 0.2f; // Same as the GL edge pass
+  int cellThreshold = 10;     // Edge pixels for a cell to count
+  CpuKernel kernel = CpuKernel::Scalar; // Resolved by init
+  // Same atlas the GL pipeline builds for the cell size (never uploaded)
+  GlyphStyle glyphStyle;
+  GlyphAtlas atlas;
+
+  // Per-pixel and per-cell results of the last run(), for diffing against
+  // the GL passes. 0 is "no edge", otherwise the direction bin + 1 (the
+  // order of edge_detect.frag's output values 0.1 ... 0.9)
+  std::vector<uint8_t> edges; // width x height, image rows top-down
+  std::vector<uint8_t> cells; // gridCols x gridRows, rows bottom-up like GL
+
+  // threads <= 0 uses every hardware thread. Auto picks the widest kernel
+  // the CPU supports
+  void init(int w, int h, int cols, int threads = 0,
+            CpuKernel requested = CpuKernel::Auto);
+  void resize(int w, int h, int cols);
+  // bgr: 8-bit BGR, top-down. out: same size BGR, top-down, what the GL
+  // pipeline's composite readback produces
+  void run(const cv::Mat &bgr, cv::Mat &out);
+  // run() from the histogram on, taking edges as they are: for checking the
+  // GL histogram and composite passes on the edges GL produced
+  void runFromEdges(cv::Mat &out);
+  // PipelineOutput::Grid / ColorGrid: gridRows x gridCols, bottom row first,
+  // 1 byte per cell (glyph index) or 4 (glyph index, R, G, B). Colours are
+  // averaged over the same 16 taps as grid_pack.frag
+  void runGrid(const cv::Mat &bgr, cv::Mat &grid, bool color);
+  // PipelineOutput::Ascii: out is BGR, top-down, each cell's glyph from the
+  // atlas in the cell's colour
+  void runAscii(const cv::Mat &bgr, cv::Mat &out);
+  // Builds the atlas for the current cell size ahead of the first frame;
+  // runGrid and runAscii do it on demand
+  bool prepareAtlas();
+
+  // Gray level GL writes for a cell value (R8 storage of 0.1 ... 0.9)
+  static uint8_t cellGray(uint8_t cell);
+
+private:
+  // Horizontal Sobel terms of one input row, per channel (B, G, R):
+  // smooth = p[x-1] + 2 p[x] + p[x+1], diff = p[x+1] - p[x-1]
+  struct RowFilter {
+    std::vector<int16_t> smooth[3], diff[3];
+  };
+  struct Scratch {
+    RowFilter rows[3]; // Ring of the rows above, at and below
+  };
+
+  void detectEdges(const cv::Mat &bgr, int band, int worker);
+  void classifyRow(const RowFilter &above, const RowFilter &row,
+                   const RowFilter &below, uint8_t *out) const;
+  void accumulateCells(int cellRow);
+  void analyze(const cv::Mat &bgr); // Edges and cells
+  void composite(cv::Mat &out);
+  void packGridRow(const cv::Mat &bgr, int cellRow, cv::Mat &grid,
+                   bool color) const;
+
+  std::unique_ptr<ThreadPool> pool;
+  std::vector<Scratch> scratch; // One per worker
+  std::vector<int> columnCell;  // Output column -> cell column
+  cv::Mat colorGrid;            // runAscii's cells
+};
@@ -0,0 +1,177 @@
+#include "frame_upload.h"
+#include "gl_ext.h"
+#include "profiler.h"
+#include <cstring>
+#include <iostream>
+
+struct PlaneLayout {
+  int width, height;
+  GLenum internalFormat, format;
+  int bytesPerPixel;
+};
+
+bool yuvUploadSupported(int w, int h) { return w % 2 == 0 && h % 2 == 0; }
+
+static int planeLayouts(PixelFormat fmt, int w, int h, PlaneLayout out[3]) {
+  // Chroma is subsampled 2x2, exactly: see yuvUploadSupported
+  int cw = w / 2, ch = h / 2;
+  switch (fmt) {
+  case PixelFormat::BGR:
+    out[0] = {w, h, GL_RGB8, GL_BGR, 3};
+    return 1;
+  case PixelFormat::NV12:
+    out[0] = {w, h, GL_R8, GL_RED, 1};
+    out[1] = {cw, ch, GL_RG8, GL_RG, 2};
+    return 2;
+  case PixelFormat::I420:
+    out[0] = {w, h, GL_R8, GL_RED, 1};
+    out[1] = {cw, ch, GL_R8, GL_RED, 1};
+    out[2] = {cw, ch, GL_R8, GL_RED, 1};
+    return 3;
+  }
+  return 0;
+}
+
+void FrameUploader::init(int w, int h, PixelFormat fmt, int slotCount,
+                         int layers) {
+  this->width = w;
+  this->height = h;
+  this->layers = layers;
+  this->format = fmt;
+  if (fmt != PixelFormat::BGR && !yuvUploadSupported(w, h))
+    std::cerr << "Odd " << w << "x" << h
+              << " frame size, YUV chroma planes will be misaligned"
+              << std::endl;
+  GLenum type = layers > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+
+  PlaneLayout planes[3];
+  this->planeCount = planeLayouts(fmt, w, h, planes);
+  this->slotBytes = 0;
+  for (int i = 0; i < this->planeCount; i++) {
+    const PlaneLayout &p = planes[i];
+    this->slotBytes += (size_t)p.width * p.height * p.bytesPerPixel;
+
+    glGenTextures(1, &this->textures[i]);
+    glBindTexture(type, this->textures[i]);
+    // Storage is allocated exactly once; frames only ever update contents
+    if (layers > 1) {
+      glTexImage3D(type, 0, p.internalFormat, p.width, p.height, layers, 0,
+                   p.format, GL_UNSIGNED_BYTE, nullptr);
+      glTexParameteri(type, GL_TEXTURE_MAX_LEVEL, 0);
+    } else if (glCaps.textureStorage) {
+      glTexStorage2D(type, 1, p.internalFormat, p.width, p.height);
+    } else {
+      glTexImage2D(type, 0, p.internalFormat, p.width, p.height, 0, p.format,
+                   GL_UNSIGNED_BYTE, nullptr);
+    }
+    // Clamp so the Sobel kernel doesn't wrap around to the opposite border
+    glTexParameteri(type, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(type, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(type, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(type, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  }
+
+  this->fences.assign(slotCount, nullptr);
+  this->persistent = glCaps.bufferStorage;
+  if (this->persistent) {
+    GLsizeiptr size = (GLsizeiptr)(this->slotBytes * slotCount);
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &this->pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->pbo);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+    this->mapped = static_cast<uint8_t *>(
+        glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (!this->mapped) {
+      std::cerr << "Persistent mapping failed, uploading from CPU memory"
+                << std::endl;
+      glDeleteBuffers(1, &this->pbo);
+      this->pbo = 0;
+      this->persistent = false;
+    }
+  }
+  if (!this->persistent)
+    this->cpuSlots.resize(this->slotBytes * slotCount);
+}
+
+uint8_t *FrameUploader::slotData(int slot) {
+  uint8_t *base = this->persistent ? this->mapped : this->cpuSlots.data();
+  return base + this->slotBytes * slot;
+}
+
+void FrameUploader::upload(int slot, int layer) {
+  ProfileSpan span("upload");
+  PlaneLayout planes[3];
+  planeLayouts(this->format, this->width, this->height, planes);
+
+  // With an unpack buffer bound the data argument is an offset into it
+  const uint8_t *src =
+      this->persistent ? nullptr : this->cpuSlots.data();
+  size_t offset = this->slotBytes * slot;
+  if (this->persistent)
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->pbo);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (int i = 0; i < this->planeCount; i++) {
+    const PlaneLayout &p = planes[i];
+    if (this->layers > 1) {
+      glBindTexture(GL_TEXTURE_2D_ARRAY, this->textures[i]);
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, p.width, p.height,
+                      1, p.format, GL_UNSIGNED_BYTE, src + offset);
+    } else {
+      glBindTexture(GL_TEXTURE_2D, this->textures[i]);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, p.width, p.height, p.format,
+                      GL_UNSIGNED_BYTE, src + offset);
+    }
+    offset += (size_t)p.width * p.height * p.bytesPerPixel;
+  }
+  if (this->persistent) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    // The copy out of the PBO happens asynchronously; the slot must not be
+    // rewritten until this fence signals
+    if (this->fences[slot])
+      glDeleteSync(this->fences[slot]);
+    this->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+}
+
+bool FrameUploader::slotFree(int slot, bool wait) {
+  GLsync fence = this->fences[slot];
+  if (!fence)
+    return true; // Client-memory uploads are copied before glTexSubImage2D returns
+  GLenum status =
+      wait ? glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                              GL_TIMEOUT_IGNORED)
+           : glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+  if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED)
+    return false;
+  glDeleteSync(fence);
+  this->fences[slot] = nullptr;
+  return true;
+}
+
+void FrameUploader::uploadImage(const cv::Mat &image, int layer) {
+  int slot = this->nextSlot;
+  this->nextSlot = (this->nextSlot + 1) % slotCount();
+  slotFree(slot, true);
+
+  size_t rowBytes = (size_t)this->width * 3;
+  uint8_t *dst = slotData(slot);
+  for (int y = 0; y < this->height; y++)
+    std::memcpy(dst + y * rowBytes, image.ptr(y), rowBytes);
+  upload(slot, layer);
+}
+
+FrameUploader::~FrameUploader() {
+  for (GLsync fence : this->fences) {
+    if (fence)
+      glDeleteSync(fence);
+  }
+  if (this->pbo) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->pbo);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &this->pbo);
+  }
+  glDeleteTextures(this->planeCount, this->textures);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <glad/gl.h>
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <vector>
+
+// Layout of a decoded frame as it sits in an upload slot
+enum class PixelFormat {
+  BGR,  // Packed 8-bit BGR, what OpenCV decodes to by default
+  NV12, // Full-res Y plane, then interleaved half-res UV
+  I420, // Full-res Y plane, then half-res U, then half-res V
+};
+
+// Raw YUV arrives as one w x h*3/2 buffer, which only splits into whole
+// half-res chroma planes when both sides are even
+bool yuvUploadSupported(int w, int h);
+
+// Streams frames into textures that are allocated once. Frames are written
+// straight into upload slots (with GL 4.4 these live in one persistently
+// mapped pixel-unpack buffer, so the decoder writes directly into GPU-visible
+// memory) and copied into the plane textures by the GPU. There is no CPU flip:
+// rows stay top-down and the first pass flips texcoords instead.
+//
+// With layers > 1 the plane textures are texture arrays holding a batch of
+// same-sized frames, one per layer, for a Pipeline with as many layers.
+struct FrameUploader {
+  PixelFormat format = PixelFormat::BGR;
+  int width = 0, height = 0;
+  int layers = 1;
+  int planeCount = 0;
+  GLuint textures[3] = {0, 0, 0}; // BGR: [rgb]; NV12: [y, uv]; I420: [y, u, v]
+
+  void init(int w, int h, PixelFormat fmt, int slotCount = 3, int layers = 1);
+  int slotCount() const { return (int)this->fences.size(); }
+  size_t frameBytes() const { return this->slotBytes; }
+  // CPU-writable memory for one frame. Safe to use from any thread, but only
+  // once slotFree(slot) has returned true since the slot was last uploaded
+  uint8_t *slotData(int slot);
+  // Copies a slot into (one layer of) the plane textures. GL thread only
+  void upload(int slot, int layer = 0);
+  // True once the GPU has finished reading the slot's last upload. GL thread
+  bool slotFree(int slot, bool wait);
+  // Convenience for still images: copies a BGR image through the next slot
+  void uploadImage(const cv::Mat &image, int layer = 0);
+  ~FrameUploader();
+
+private:
+  bool persistent = false; // Slots are in a mapped PBO rather than CPU memory
+  GLuint pbo = 0;
+  uint8_t *mapped = nullptr;
+  std::vector<uint8_t> cpuSlots; // Fallback when buffer storage is missing
+  std::vector<GLsync> fences;
+  size_t slotBytes = 0;
+  int nextSlot = 0; // Round-robin slot used by uploadImage
+};
@@ -0,0 +1,96 @@
+#include "gl_ext.h"
+#include <cstring>
+#include <iostream>
+
+PFNGLGETPROGRAMBINARYPROC ext_glGetProgramBinary = nullptr;
+PFNGLPROGRAMBINARYPROC ext_glProgramBinary = nullptr;
+PFNGLPROGRAMPARAMETERIPROC ext_glProgramParameteri = nullptr;
+PFNGLTEXSTORAGE2DPROC ext_glTexStorage2D = nullptr;
+PFNGLBUFFERSTORAGEPROC ext_glBufferStorage = nullptr;
+PFNGLBINDIMAGETEXTUREPROC ext_glBindImageTexture = nullptr;
+PFNGLMEMORYBARRIERPROC ext_glMemoryBarrier = nullptr;
+PFNGLDISPATCHCOMPUTEPROC ext_glDispatchCompute = nullptr;
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC ext_glMaxShaderCompilerThreadsKHR =
+    nullptr;
+
+GLCapabilities glCaps;
+
+static bool atLeast(int major, int minor) {
+  return glCaps.major > major || (glCaps.major == major && glCaps.minor >= minor);
+}
+
+bool hasGLExtension(const char *name) {
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (GLint i = 0; i < count; i++) {
+    const char *ext = (const char *)glGetStringi(GL_EXTENSIONS, i);
+    if (ext && std::strcmp(ext, name) == 0)
+      return true;
+  }
+  return false;
+}
+
+void loadGLExtensions(GLADloadfunc load, int glVersion) {
+  glCaps = GLCapabilities();
+  glCaps.major = GLAD_VERSION_MAJOR(glVersion);
+  glCaps.minor = GLAD_VERSION_MINOR(glVersion);
+
+  if (atLeast(4, 1) || hasGLExtension("GL_ARB_get_program_binary")) {
+    ext_glGetProgramBinary =
+        (PFNGLGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+    ext_glProgramBinary = (PFNGLPROGRAMBINARYPROC)load("glProgramBinary");
+    ext_glProgramParameteri =
+        (PFNGLPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+    // Drivers may expose the entry points but support zero binary formats
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    glCaps.programBinary = ext_glGetProgramBinary && ext_glProgramBinary &&
+                           ext_glProgramParameteri && formats > 0;
+  }
+  if (atLeast(4, 2) || hasGLExtension("GL_ARB_texture_storage")) {
+    ext_glTexStorage2D = (PFNGLTEXSTORAGE2DPROC)load("glTexStorage2D");
+    glCaps.textureStorage = ext_glTexStorage2D != nullptr;
+  }
+  if (atLeast(4, 4) || hasGLExtension("GL_ARB_buffer_storage")) {
+    ext_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)load("glBufferStorage");
+    glCaps.bufferStorage = ext_glBufferStorage != nullptr;
+  }
+  // Compute shaders are written against GLSL 4.30, so require the version
+  // rather than piecing it together from extensions
+  if (atLeast(4, 3)) {
+    ext_glBindImageTexture =
+        (PFNGLBINDIMAGETEXTUREPROC)load("glBindImageTexture");
+    ext_glMemoryBarrier = (PFNGLMEMORYBARRIERPROC)load("glMemoryBarrier");
+    ext_glDispatchCompute = (PFNGLDISPATCHCOMPUTEPROC)load("glDispatchCompute");
+    glCaps.computeShaders = ext_glBindImageTexture && ext_glMemoryBarrier &&
+                            ext_glDispatchCompute;
+  }
+  if (hasGLExtension("GL_KHR_parallel_shader_compile")) {
+    ext_glMaxShaderCompilerThreadsKHR =
+        (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load(
+            "glMaxShaderCompilerThreadsKHR");
+  } else if (hasGLExtension("GL_ARB_parallel_shader_compile")) {
+    ext_glMaxShaderCompilerThreadsKHR =
+        (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load(
+            "glMaxShaderCompilerThreadsARB");
+  }
+  if (ext_glMaxShaderCompilerThreadsKHR) {
+    // Let the driver pick how many threads to compile on
+    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    glCaps.parallelShaderCompile = true;
+  }
+
+  if (hasGLExtension("GL_ARB_shader_viewport_layer_array"))
+    glCaps.vertexShaderLayer = "GL_ARB_shader_viewport_layer_array";
+  else if (hasGLExtension("GL_AMD_vertex_shader_layer"))
+    glCaps.vertexShaderLayer = "GL_AMD_vertex_shader_layer";
+
+  std::cout << "OpenGL " << glCaps.major << "." << glCaps.minor
+            << (glCaps.textureStorage ? " +texture_storage" : "")
+            << (glCaps.bufferStorage ? " +buffer_storage" : "")
+            << (glCaps.computeShaders ? " +compute" : "")
+            << (glCaps.programBinary ? " +program_binary" : "")
+            << (glCaps.parallelShaderCompile ? " +parallel_compile" : "")
+            << (glCaps.vertexShaderLayer ? " +vertex_layer" : "")
+            << std::endl;
+}
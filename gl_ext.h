@@ -0,0 +1,97 @@
+#pragma once
+#include <glad/gl.h>
+
+// OpenGL 4.x entry points atsuki can take advantage of. The bundled glad
+// loader was generated for core 3.3 only, so these are resolved by hand with
+// the same loader function after gladLoadGL. They are null when the context
+// doesn't provide them: check the matching glCaps flag before calling.
+
+// GL 4.1 / ARB_get_program_binary
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+typedef void(GLAD_API_PTR *PFNGLGETPROGRAMBINARYPROC)(GLuint program,
+                                                      GLsizei bufSize,
+                                                      GLsizei *length,
+                                                      GLenum *binaryFormat,
+                                                      void *binary);
+typedef void(GLAD_API_PTR *PFNGLPROGRAMBINARYPROC)(GLuint program,
+                                                   GLenum binaryFormat,
+                                                   const void *binary,
+                                                   GLsizei length);
+typedef void(GLAD_API_PTR *PFNGLPROGRAMPARAMETERIPROC)(GLuint program,
+                                                       GLenum pname,
+                                                       GLint value);
+extern PFNGLGETPROGRAMBINARYPROC ext_glGetProgramBinary;
+extern PFNGLPROGRAMBINARYPROC ext_glProgramBinary;
+extern PFNGLPROGRAMPARAMETERIPROC ext_glProgramParameteri;
+#define glGetProgramBinary ext_glGetProgramBinary
+#define glProgramBinary ext_glProgramBinary
+#define glProgramParameteri ext_glProgramParameteri
+
+// GL 4.2 / ARB_texture_storage
+#define GL_TEXTURE_IMMUTABLE_FORMAT 0x912F
+typedef void(GLAD_API_PTR *PFNGLTEXSTORAGE2DPROC)(GLenum target, GLsizei levels,
+                                                  GLenum internalformat,
+                                                  GLsizei width,
+                                                  GLsizei height);
+extern PFNGLTEXSTORAGE2DPROC ext_glTexStorage2D;
+#define glTexStorage2D ext_glTexStorage2D
+
+// GL 4.4 / ARB_buffer_storage
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#define GL_CLIENT_STORAGE_BIT 0x0200
+typedef void(GLAD_API_PTR *PFNGLBUFFERSTORAGEPROC)(GLenum target,
+                                                   GLsizeiptr size,
+                                                   const void *data,
+                                                   GLbitfield flags);
+extern PFNGLBUFFERSTORAGEPROC ext_glBufferStorage;
+#define glBufferStorage ext_glBufferStorage
+
+// GL 4.2 / ARB_shader_image_load_store
+#define GL_TEXTURE_FETCH_BARRIER_BIT 0x00000008
+#define GL_SHADER_IMAGE_ACCESS_BARRIER_BIT 0x00000020
+#define GL_FRAMEBUFFER_BARRIER_BIT 0x00000400
+typedef void(GLAD_API_PTR *PFNGLBINDIMAGETEXTUREPROC)(
+    GLuint unit, GLuint texture, GLint level, GLboolean layered, GLint layer,
+    GLenum access, GLenum format);
+typedef void(GLAD_API_PTR *PFNGLMEMORYBARRIERPROC)(GLbitfield barriers);
+extern PFNGLBINDIMAGETEXTUREPROC ext_glBindImageTexture;
+extern PFNGLMEMORYBARRIERPROC ext_glMemoryBarrier;
+#define glBindImageTexture ext_glBindImageTexture
+#define glMemoryBarrier ext_glMemoryBarrier
+
+// GL 4.3 / ARB_compute_shader
+#define GL_COMPUTE_SHADER 0x91B9
+typedef void(GLAD_API_PTR *PFNGLDISPATCHCOMPUTEPROC)(GLuint num_groups_x,
+                                                     GLuint num_groups_y,
+                                                     GLuint num_groups_z);
+extern PFNGLDISPATCHCOMPUTEPROC ext_glDispatchCompute;
+#define glDispatchCompute ext_glDispatchCompute
+
+// KHR_parallel_shader_compile (or the ARB variant): compile and link return
+// immediately and GL_COMPLETION_STATUS_KHR can be polled without blocking
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+typedef void(GLAD_API_PTR *PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+extern PFNGLMAXSHADERCOMPILERTHREADSKHRPROC ext_glMaxShaderCompilerThreadsKHR;
+#define glMaxShaderCompilerThreadsKHR ext_glMaxShaderCompilerThreadsKHR
+
+struct GLCapabilities {
+  int major = 0, minor = 0;
+  bool textureStorage = false; // Immutable textures (glTexStorage2D)
+  bool bufferStorage = false;  // Persistently mapped buffers
+  bool computeShaders = false; // GLSL 4.30 compute + image load/store
+  bool programBinary = false;  // Driver can save/restore linked programs
+  bool parallelShaderCompile = false; // Non-blocking completion queries
+  // gl_Layer is writable from vertex shaders, so a layered target takes one
+  // instanced draw. Names the extension to enable, null when missing
+  const char *vertexShaderLayer = nullptr;
+};
+extern GLCapabilities glCaps;
+
+// Call once per context, right after gladLoadGL succeeded. glVersion is
+// gladLoadGL's return value
+void loadGLExtensions(GLADloadfunc load, int glVersion);
+bool hasGLExtension(const char *name);
@@ -0,0 +1,309 @@
+#include "glyph_atlas.h"
+#include "shader_cache.h"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char kDefaultCharset[] = " .:-=+*#%@";
+const char kEdgeGlyphs[8] = {'-', '\\', '|', '/', '-', '\\', '|', '/'};
+
+// Cache file layout: header, the glyph characters (sorted), then pixels
+// starting at pixelOffset
+struct AtlasHeader {
+  char magic[4]; // "ATGA"
+  uint32_t version;
+  int32_t font, cellWidth, cellHeight, cols, rows;
+  int32_t glyphCount, brightnessLevels;
+  uint32_t pixelOffset;
+};
+static const uint32_t kAtlasVersion = 1;
+
+int hersheyFontFromName(const std::string &name) {
+  static const struct {
+    const char *name;
+    int font;
+  } fonts[] = {
+      {"simplex", cv::FONT_HERSHEY_SIMPLEX},
+      {"plain", cv::FONT_HERSHEY_PLAIN},
+      {"duplex", cv::FONT_HERSHEY_DUPLEX},
+      {"complex", cv::FONT_HERSHEY_COMPLEX},
+      {"triplex", cv::FONT_HERSHEY_TRIPLEX},
+      {"complex-small", cv::FONT_HERSHEY_COMPLEX_SMALL},
+      {"script-simplex", cv::FONT_HERSHEY_SCRIPT_SIMPLEX},
+      {"script-complex", cv::FONT_HERSHEY_SCRIPT_COMPLEX},
+  };
+  for (const auto &f : fonts) {
+    if (name == f.name)
+      return f.font;
+  }
+  return -1;
+}
+
+std::string GlyphAtlas::defaultDirectory() {
+  const char *xdg = std::getenv("XDG_CACHE_HOME");
+  if (xdg && *xdg)
+    return std::string(xdg) + "/atsuki/atlases";
+  const char *home = std::getenv("HOME");
+  if (home && *home)
+    return std::string(home) + "/.cache/atsuki/atlases";
+  return ".atsuki-cache/atlases";
+}
+
+GlyphAtlas::~GlyphAtlas() {
+  release();
+  if (this->texture)
+    glDeleteTextures(1, &this->texture);
+}
+
+void GlyphAtlas::release() {
+  if (this->mapping)
+    munmap(this->mapping, this->mappingSize);
+  this->mapping = nullptr;
+  this->mappingSize = 0;
+  this->owned.clear();
+  this->pixels = nullptr;
+}
+
+bool GlyphAtlas::build(const std::string &charset, int font, int cellW,
+                       int cellH, const std::string &directory) {
+  release();
+  if (charset.empty() || (int)charset.size() > kMaxCharsetLength ||
+      cellW <= 0 || cellH <= 0) {
+    std::cerr << "Glyph atlas: need 1-" << kMaxCharsetLength
+              << " glyphs and a positive cell size" << std::endl;
+    return false;
+  }
+  this->charset = charset;
+  this->font = font;
+  this->cellWidth = cellW;
+  this->cellHeight = cellH;
+  this->brightnessLevels = (int)charset.size();
+  int count = this->brightnessLevels + 8;
+  this->cols = (int)std::ceil(std::sqrt((double)count));
+  this->rows = (count + this->cols - 1) / this->cols;
+
+  std::string path;
+  if (!directory.empty()) {
+    int32_t params[4] = {(int32_t)kAtlasVersion, font, cellW, cellH};
+    uint64_t hash = hashBytes(params, sizeof(params));
+    hash = hashBytes(charset.data(), charset.size(), hash);
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.atlas",
+                  (unsigned long long)hash);
+    path = directory + "/" + name;
+    if (load(path, charset)) {
+      this->fromCache = true;
+      return true;
+    }
+  }
+
+  this->fromCache = false;
+  rasterize(charset);
+  if (!path.empty())
+    store(path);
+  return true;
+}
+
+bool GlyphAtlas::prepare(const GlyphStyle &style, int cellW, int cellH) {
+  if (this->pixels && this->font == style.font &&
+      this->cellWidth == cellW && this->cellHeight == cellH &&
+      this->charset == style.charset)
+    return true;
+  std::string directory;
+  if (style.useCache)
+    directory = style.cacheDir.empty() ? defaultDirectory() : style.cacheDir;
+  return build(style.charset, style.font, cellW, cellH, directory);
+}
+
+bool GlyphAtlas::load(const std::string &path, const std::string &charset) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(AtlasHeader))
+    map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // The mapping stays valid
+  if (map == MAP_FAILED)
+    return false;
+  this->mapping = map;
+  this->mappingSize = st.st_size;
+
+  // Anything unexpected (older version, truncated write, hash collision)
+  // is a miss; the rebuild overwrites it
+  AtlasHeader header;
+  std::memcpy(&header, map, sizeof(header));
+  size_t pixelBytes = (size_t)width() * height();
+  const char *bytes = static_cast<const char *>(map);
+  if (std::memcmp(header.magic, "ATGA", 4) != 0 ||
+      header.version != kAtlasVersion || header.font != this->font ||
+      header.cellWidth != this->cellWidth ||
+      header.cellHeight != this->cellHeight || header.cols != this->cols ||
+      header.rows != this->rows ||
+      header.brightnessLevels != this->brightnessLevels ||
+      header.glyphCount != this->brightnessLevels + 8 ||
+      header.pixelOffset < sizeof(header) + header.glyphCount ||
+      header.pixelOffset + pixelBytes != this->mappingSize) {
+    release();
+    return false;
+  }
+  this->glyphs.assign(bytes + sizeof(header), header.glyphCount);
+  // Same characters, possibly reordered by coverage
+  std::string sorted = this->glyphs.substr(0, this->brightnessLevels);
+  std::string expected = charset;
+  std::sort(sorted.begin(), sorted.end());
+  std::sort(expected.begin(), expected.end());
+  if (sorted != expected) {
+    release();
+    return false;
+  }
+  this->pixels = reinterpret_cast<const uint8_t *>(bytes) + header.pixelOffset;
+  return true;
+}
+
+void GlyphAtlas::rasterize(const std::string &charset) {
+  // One scale for every glyph, so relative sizes (and coverage) stay true
+  // to the font. Fit the tallest glyph box and the widest advance
+  int maxWidth = 1, maxAscent = 1, maxDescent = 0;
+  std::string all = charset + std::string(kEdgeGlyphs, 8);
+  for (char c : all) {
+    int baseline = 0;
+    cv::Size size =
+        cv::getTextSize(std::string(1, c), this->font, 1.0, 1, &baseline);
+    maxWidth = std::max(maxWidth, size.width);
+    maxAscent = std::max(maxAscent, size.height);
+    maxDescent = std::max(maxDescent, baseline);
+  }
+  double scale = std::min(0.9 * this->cellWidth / maxWidth,
+                          0.9 * this->cellHeight / (maxAscent + maxDescent));
+  int baselineY = (int)std::lround(
+      (this->cellHeight + (maxAscent - maxDescent) * scale) / 2.0);
+
+  auto draw = [&](char c) {
+    cv::Mat cell(this->cellHeight, this->cellWidth, CV_8UC1, cv::Scalar(0));
+    int baseline = 0;
+    cv::Size size =
+        cv::getTextSize(std::string(1, c), this->font, scale, 1, &baseline);
+    cv::Point origin((this->cellWidth - size.width) / 2, baselineY);
+    cv::putText(cell, std::string(1, c), origin, this->font, scale,
+                cv::Scalar(255), 1, cv::LINE_AA);
+    return cell;
+  };
+
+  std::vector<cv::Mat> cells;
+  std::vector<double> coverage;
+  for (char c : charset) {
+    cells.push_back(draw(c));
+    double ink = 0;
+    const cv::Mat &cell = cells.back();
+    for (int y = 0; y < cell.rows; y++) {
+      const uint8_t *row = cell.ptr(y);
+      for (int x = 0; x < cell.cols; x++)
+        ink += row[x];
+    }
+    coverage.push_back(ink / (255.0 * cell.rows * cell.cols));
+  }
+  std::vector<int> order(charset.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&](int a, int b) { return coverage[a] < coverage[b]; });
+
+  this->glyphs.clear();
+  std::vector<cv::Mat> sorted;
+  for (int i : order) {
+    this->glyphs += charset[i];
+    sorted.push_back(cells[i]);
+  }
+  for (char c : kEdgeGlyphs) {
+    this->glyphs += c;
+    sorted.push_back(draw(c));
+  }
+
+  this->owned.assign((size_t)width() * height(), 0);
+  for (size_t i = 0; i < sorted.size(); i++) {
+    int x0 = (int)(i % this->cols) * this->cellWidth;
+    int y0 = (int)(i / this->cols) * this->cellHeight;
+    for (int y = 0; y < this->cellHeight; y++)
+      std::memcpy(&this->owned[(size_t)(y0 + y) * width() + x0],
+                  sorted[i].ptr(y), this->cellWidth);
+  }
+  this->pixels = this->owned.data();
+}
+
+void GlyphAtlas::store(const std::string &path) const {
+  std::error_code ec;
+  std::filesystem::create_directories(
+      std::filesystem::path(path).parent_path(), ec);
+  AtlasHeader header = {{'A', 'T', 'G', 'A'},
+                        kAtlasVersion,
+                        this->font,
+                        this->cellWidth,
+                        this->cellHeight,
+                        this->cols,
+                        this->rows,
+                        (int32_t)this->glyphs.size(),
+                        this->brightnessLevels,
+                        0};
+  // Pixels 16-byte aligned within the file (and so within the mapping)
+  header.pixelOffset =
+      (uint32_t)((sizeof(header) + this->glyphs.size() + 15) / 16 * 16);
+  // Write then rename so a concurrent reader never maps half a file. The
+  // temporary name is per process, as another one may build the same atlas
+  std::string tmpPath = path + "." + std::to_string(getpid()) + ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(this->glyphs.data(), this->glyphs.size());
+    std::vector<char> padding(header.pixelOffset - sizeof(header) -
+                                  this->glyphs.size(),
+                              0);
+    file.write(padding.data(), padding.size());
+    file.write(reinterpret_cast<const char *>(this->pixels),
+               (std::streamsize)width() * height());
+    if (!file) {
+      std::cerr << "Glyph atlas: failed to write " << tmpPath << std::endl;
+      return;
+    }
+  }
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec)
+    std::filesystem::remove(tmpPath, ec);
+}
+
+void GlyphAtlas::upload() {
+  if (!this->texture)
+    glGenTextures(1, &this->texture);
+  glBindTexture(GL_TEXTURE_2D, this->texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width(), height(), 0, GL_RED,
+               GL_UNSIGNED_BYTE, this->pixels);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  // Glyphs are packed with no padding. A level may only halve cells that
+  // split evenly, so no texel spans two glyphs, and must keep each cell at
+  // least 2 texels wide, so filtering within a cell doesn't reach the next
+  auto halves = [](int cell, int level) {
+    return cell % (2 << level) == 0 && (cell >> (level + 1)) >= 2;
+  };
+  int levels = 0;
+  while (halves(this->cellWidth, levels) && halves(this->cellHeight, levels))
+    levels++;
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels);
+  glGenerateMipmap(GL_TEXTURE_2D);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <glad/gl.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Brightness glyphs when no --charset is given. Order doesn't matter: the
+// atlas sorts them by coverage
+extern const char kDefaultCharset[];
+// Longest charset: with the 8 edge glyphs the total still fits the u8 glyph
+// count of a binary grid's 'G' record (grid_output.h)
+const int kMaxCharsetLength = 247;
+// One glyph per edge direction bin, appended after the brightness glyphs.
+// Bins 0 and 4 are vertical gradients, 2 and 6 horizontal ones; 1 and 5
+// point up-right/down-left in the image, 3 and 7 down-right/up-left. Each
+// glyph runs perpendicular to its gradient
+extern const char kEdgeGlyphs[8];
+
+// cv::FONT_HERSHEY_* for "simplex", "plain", "duplex", "complex",
+// "triplex", "complex-small", "script-simplex" or "script-complex"; -1 if
+// the name is unknown
+int hersheyFontFromName(const std::string &name);
+
+// What the atlas is built from, as chosen on the command line
+struct GlyphStyle {
+  std::string charset = kDefaultCharset;
+  int font = 0; // cv::FONT_HERSHEY_SIMPLEX
+  bool useCache = true;
+  std::string cacheDir; // Empty = GlyphAtlas::defaultDirectory()
+};
+
+// A charset rasterized with one of OpenCV's Hershey fonts, one glyph per
+// cell, as an 8-bit ink coverage image. Brightness glyphs are sorted by
+// measured coverage, lightest first, so a brightness level maps linearly to
+// ink; the edge glyphs follow in bin order. Glyph index i (what
+// grid_pack.frag writes) is atlas cell i, row-major from the top left.
+//
+// Atlases are cached as <directory>/<key>.atlas, keyed by charset, font and
+// cell size. A cached atlas is memory-mapped and uploaded straight from the
+// mapping instead of being rasterized again.
+struct GlyphAtlas {
+  std::string glyphs;       // Character for each glyph index
+  int brightnessLevels = 0; // Leading glyphs that encode brightness
+  int font = 0;
+  int cellWidth = 0, cellHeight = 0;
+  int cols = 0, rows = 0; // Layout in cells
+  // (rows * cellHeight) x (cols * cellWidth) coverage, top row first
+  const uint8_t *pixels = nullptr;
+  bool fromCache = false;
+  GLuint texture = 0; // R8 with mipmaps, after upload()
+
+  GlyphAtlas() = default;
+  GlyphAtlas(const GlyphAtlas &) = delete;
+  GlyphAtlas &operator=(const GlyphAtlas &) = delete;
+  ~GlyphAtlas();
+
+  // Maps the cached atlas or rasterizes (and caches) a new one. An empty
+  // directory disables the cache. Returns false if nothing could be built
+  bool build(const std::string &charset, int font, int cellW, int cellH,
+             const std::string &directory);
+  // build() unless the atlas already matches style and cell size, so grid
+  // size changes back and forth only cost a cache lookup
+  bool prepare(const GlyphStyle &style, int cellW, int cellH);
+  // Needs a current context. Replaces any previous texture
+  void upload();
+  int width() const { return this->cols * this->cellWidth; }
+  int height() const { return this->rows * this->cellHeight; }
+
+  // $XDG_CACHE_HOME/atsuki/atlases, else ~/.cache/atsuki/atlases
+  static std::string defaultDirectory();
+
+private:
+  void release();
+  bool load(const std::string &path, const std::string &charset);
+  void rasterize(const std::string &charset);
+  void store(const std::string &path) const;
+
+  std::string charset;        // As requested, before sorting
+  std::vector<uint8_t> owned; // Pixels of a freshly rasterized atlas
+  void *mapping = nullptr;    // Pixels of a cached one
+  size_t mappingSize = 0;
+};
@@ -0,0 +1,105 @@
+#include "grid_output.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+static void putU16(FILE *f, uint16_t v) {
+  uint8_t b[2] = {(uint8_t)v, (uint8_t)(v >> 8)};
+  fwrite(b, 1, 2, f);
+}
+
+static void putU32(FILE *f, uint32_t v) {
+  uint8_t b[4] = {(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16),
+                  (uint8_t)(v >> 24)};
+  fwrite(b, 1, 4, f);
+}
+
+bool GridWriter::open(const std::string &path, GridFormat format) {
+  close();
+  if (path == "-") {
+    this->file = stdout;
+  } else {
+    this->file = fopen(path.c_str(), format == GridFormat::Binary ? "wb" : "w");
+    if (!this->file) {
+      std::cerr << "Failed to open grid output " << path << ": "
+                << std::strerror(errno) << std::endl;
+      return false;
+    }
+    this->ownsFile = true;
+  }
+  this->format = format;
+  this->frames = 0;
+  this->glyphsWritten = false;
+
+  if (format == GridFormat::Binary) {
+    fwrite("ATSG", 1, 4, this->file);
+    fputc(2, this->file);
+  } else if (format == GridFormat::Ansi) {
+    fputs("\x1b[2J", this->file); // Clear once; frames then redraw in place
+  }
+  return true;
+}
+
+void GridWriter::setGlyphs(const std::string &glyphs) {
+  if (glyphs != this->glyphs)
+    this->glyphsWritten = false;
+  this->glyphs = glyphs;
+}
+
+bool GridWriter::write(const uint8_t *grid, int cols, int rows,
+                       int channels) {
+  if (!this->file)
+    return false;
+  if (this->format == GridFormat::Binary) {
+    if (!this->glyphsWritten) {
+      fputc('G', this->file);
+      fputc((uint8_t)this->glyphs.size(), this->file);
+      fwrite(this->glyphs.data(), 1, this->glyphs.size(), this->file);
+      this->glyphsWritten = true;
+    }
+    fputc('F', this->file);
+    putU16(this->file, (uint16_t)cols);
+    putU16(this->file, (uint16_t)rows);
+    fputc(channels, this->file);
+    putU32(this->file, (uint32_t)this->frames);
+    for (int y = rows - 1; y >= 0; y--)
+      fwrite(grid + (size_t)y * cols * channels, 1, (size_t)cols * channels,
+             this->file);
+  } else {
+    bool color = this->format == GridFormat::Ansi && channels == 4;
+    if (this->format == GridFormat::Ansi)
+      fputs("\x1b[H", this->file);
+    else if (this->frames > 0)
+      fputc('\n', this->file);
+    for (int y = rows - 1; y >= 0; y--) {
+      const uint8_t *cell = grid + (size_t)y * cols * channels;
+      this->line.clear();
+      for (int x = 0; x < cols; x++, cell += channels) {
+        if (color) {
+          char escape[24];
+          snprintf(escape, sizeof(escape), "\x1b[38;2;%d;%d;%dm", cell[1],
+                   cell[2], cell[3]);
+          this->line += escape;
+        }
+        this->line +=
+            cell[0] < this->glyphs.size() ? this->glyphs[cell[0]] : '?';
+      }
+      if (color)
+        this->line += "\x1b[0m";
+      this->line += '\n';
+      fwrite(this->line.data(), 1, this->line.size(), this->file);
+    }
+  }
+  this->frames++;
+  fflush(this->file);
+  return !ferror(this->file);
+}
+
+void GridWriter::close() {
+  if (this->file && this->ownsFile)
+    fclose(this->file);
+  else if (this->file)
+    fflush(this->file);
+  this->file = nullptr;
+  this->ownsFile = false;
+}
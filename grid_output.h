@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+enum class GridFormat {
+  None,   // Full-frame images/videos, no grid output
+  Text,   // One line of glyphs per grid row, a blank line between frames
+  Ansi,   // Glyphs in 24-bit colour, redrawn in place (for terminals)
+  Binary, // Header, then per frame the raw grid (see GridWriter)
+};
+
+// Streams grids read back from PipelineOutput::Grid / ColorGrid to stdout
+// or a file. Grids arrive as GL stores them, bottom row first, with 1 byte
+// per cell (glyph index) or 4 (glyph index, R, G, B). Glyph indices refer
+// to GlyphAtlas::glyphs.
+//
+// Binary layout, little-endian: "ATSG", u8 version (2), then records. A 'G'
+// record (u8 glyph count, the glyph characters) comes before the first
+// frame and again whenever the glyph table changes. An 'F' record is one
+// frame: u16 cols, u16 rows, u8 channels (1 or 4), u32 frame index, and
+// cols x rows x channels bytes, top row first.
+struct GridWriter {
+  GridFormat format = GridFormat::None;
+  int frames = 0;
+
+  // "-" writes to stdout
+  bool open(const std::string &path, GridFormat format);
+  // Table for the frames that follow
+  void setGlyphs(const std::string &glyphs);
+  bool write(const uint8_t *grid, int cols, int rows, int channels);
+  void close();
+  ~GridWriter() { close(); }
+
+private:
+  FILE *file = nullptr;
+  bool ownsFile = false;
+  std::string glyphs;
+  bool glyphsWritten = false;
+  std::string line; // Reused per row
+};
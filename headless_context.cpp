@@ -0,0 +1,123 @@
+#include "headless_context.h"
+#include <EGL/eglext.h>
+#include <cstring>
+#include <iostream>
+
+static bool hasExtension(const char *extensions, const char *name) {
+  if (!extensions)
+    return false;
+  size_t len = std::strlen(name);
+  for (const char *p = std::strstr(extensions, name); p;
+       p = std::strstr(p + len, name)) {
+    // Make sure we matched a whole token, not a prefix of a longer name
+    if ((p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0'))
+      return true;
+  }
+  return false;
+}
+
+static EGLDisplay openSurfacelessDisplay() {
+  const char *clientExts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  if (!hasExtension(clientExts, "EGL_MESA_platform_surfaceless"))
+    return EGL_NO_DISPLAY;
+  auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+      "eglGetPlatformDisplayEXT");
+  if (!getPlatformDisplay)
+    return EGL_NO_DISPLAY;
+  return getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY,
+                            nullptr);
+}
+
+bool HeadlessContext::init() {
+  bool surfaceless = true;
+  this->display = openSurfacelessDisplay();
+  if (this->display == EGL_NO_DISPLAY ||
+      !eglInitialize(this->display, nullptr, nullptr)) {
+    surfaceless = false;
+    this->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (this->display == EGL_NO_DISPLAY ||
+        !eglInitialize(this->display, nullptr, nullptr)) {
+      std::cerr << "Failed to initialize an EGL display" << std::endl;
+      return false;
+    }
+  }
+  // Surfaceless rendering also needs the display to allow contexts without
+  // any surface bound
+  if (surfaceless &&
+      !hasExtension(eglQueryString(this->display, EGL_EXTENSIONS),
+                    "EGL_KHR_surfaceless_context")) {
+    surfaceless = false;
+  }
+
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    std::cerr << "EGL does not support desktop OpenGL" << std::endl;
+    return false;
+  }
+
+  const EGLint configAttribs[] = {
+      EGL_SURFACE_TYPE,    surfaceless ? 0 : EGL_PBUFFER_BIT,
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+      EGL_RED_SIZE,        8,
+      EGL_GREEN_SIZE,      8,
+      EGL_BLUE_SIZE,       8,
+      EGL_NONE,
+  };
+  EGLConfig config;
+  EGLint numConfigs = 0;
+  if (!eglChooseConfig(this->display, configAttribs, &config, 1,
+                       &numConfigs) ||
+      numConfigs == 0) {
+    std::cerr << "No suitable EGL config found" << std::endl;
+    return false;
+  }
+
+  // Same context version as the windowed path so shaders behave identically
+  const EGLint contextAttribs[] = {
+      EGL_CONTEXT_MAJOR_VERSION,       3,
+      EGL_CONTEXT_MINOR_VERSION,       3,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+      EGL_NONE,
+  };
+  this->context =
+      eglCreateContext(this->display, config, EGL_NO_CONTEXT, contextAttribs);
+  if (this->context == EGL_NO_CONTEXT) {
+    std::cerr << "Failed to create EGL context (error 0x" << std::hex
+              << eglGetError() << std::dec << ")" << std::endl;
+    return false;
+  }
+
+  if (!surfaceless) {
+    const EGLint pbufferAttribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+    this->surface =
+        eglCreatePbufferSurface(this->display, config, pbufferAttribs);
+    if (this->surface == EGL_NO_SURFACE) {
+      std::cerr << "Failed to create EGL pbuffer surface" << std::endl;
+      return false;
+    }
+  }
+
+  if (!eglMakeCurrent(this->display, this->surface, this->surface,
+                      this->context)) {
+    std::cerr << "Failed to make EGL context current" << std::endl;
+    return false;
+  }
+  std::cout << "Headless context: "
+            << (surfaceless ? "EGL surfaceless" : "EGL pbuffer") << std::endl;
+  return true;
+}
+
+HeadlessContext::~HeadlessContext() {
+  if (this->display == EGL_NO_DISPLAY)
+    return;
+  eglMakeCurrent(this->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                 EGL_NO_CONTEXT);
+  if (this->surface != EGL_NO_SURFACE)
+    eglDestroySurface(this->display, this->surface);
+  if (this->context != EGL_NO_CONTEXT)
+    eglDestroyContext(this->display, this->context);
+  eglTerminate(this->display);
+}
+
+GLADapiproc headlessGetProcAddress(const char *name) {
+  return (GLADapiproc)eglGetProcAddress(name);
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <EGL/egl.h>
+#include <glad/gl.h>
+
+// Offscreen OpenGL context for machines without a display (render boxes, CI).
+// Prefers Mesa's surfaceless platform and falls back to a 1x1 pbuffer on the
+// default EGL display. Works with llvmpipe.
+struct HeadlessContext {
+  EGLDisplay display = EGL_NO_DISPLAY;
+  EGLContext context = EGL_NO_CONTEXT;
+  EGLSurface surface = EGL_NO_SURFACE; // Only used by the pbuffer fallback
+
+  // Creates the context and makes it current on the calling thread
+  bool init();
+  ~HeadlessContext();
+};
+
+// Loader for gladLoadGL while a HeadlessContext is current
+GLADapiproc headlessGetProcAddress(const char *name);
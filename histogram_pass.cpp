@@ -0,0 +1,72 @@
+#include "histogram_pass.h"
+#include "gl_ext.h"
+#include <iostream>
+
+void HistogramPass::init(const std::string &shaderDir, bool allowCompute,
+                         bool temporal, bool layered) {
+  this->useCompute = allowCompute && glCaps.computeShaders;
+  this->params.init(HistogramParamsBinding);
+  if (!this->useCompute) {
+    // One quad per dirty cell instead of the whole target
+    this->fragmentPass.init(shaderDir + (temporal ? "/cell_quad.vert"
+                                                  : "/fullscreen_quad.vert"),
+                            shaderDir + "/histogram.frag",
+                            layered ? layeredDefines() : "");
+    this->fragmentPass.shader->setFixedUniform("u_image", 0);
+    this->fragmentPass.shader->setFixedUniform("u_dirty", 1);
+    this->fragmentPass.clearTarget = !temporal;
+    this->fragmentPass.shader->bindBlock("HistogramParams",
+                                         HistogramParamsBinding);
+    return;
+  }
+  std::string defines;
+  if (temporal)
+    defines += "#define TEMPORAL 1\n";
+  if (layered)
+    defines += "#define LAYERED 1\n";
+  this->computeShader =
+      ShaderProgram::compute(shaderDir + "/histogram.comp", defines);
+  this->computeShader->setFixedUniform("u_image", 0);
+  this->computeShader->setFixedUniform("u_dirty", 1);
+  this->computeShader->setFixedUniform("u_output", 0); // Image unit
+  this->computeShader->bindBlock("HistogramParams", HistogramParamsBinding);
+  std::cout << "Histogram: compute shader path" << std::endl;
+}
+
+void HistogramPass::run(GLuint edgeTex, GLuint vao, int threshold,
+                        const RenderTarget &target, GLuint dirtyTex) {
+  this->params.set(&HistogramParams::gridCellDimensions,
+                   GLVec2{(float)target.width, (float)target.height});
+  this->params.set(&HistogramParams::threshold, threshold);
+  auto bindDirty = [&] {
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, dirtyTex);
+    glActiveTexture(GL_TEXTURE0);
+  };
+  if (!this->useCompute) {
+    if (dirtyTex)
+      this->fragmentPass.instanceCount = target.width * target.height;
+    this->fragmentPass.setTarget(target);
+    this->fragmentPass.run(edgeTex, vao, [&](GLuint) {
+      this->params.bind();
+      bindDirty();
+    });
+    return;
+  }
+
+  this->computeShader->reloadIfChanged();
+  glUseProgram(this->computeShader->id);
+  this->params.bind();
+
+  bool layered = target.layers > 1;
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(layered ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, edgeTex);
+  bindDirty();
+  glBindImageTexture(0, target.texture, 0, layered ? GL_TRUE : GL_FALSE, 0,
+                     GL_WRITE_ONLY, GL_R8);
+
+  // One workgroup per cell, and per layer
+  glDispatchCompute(target.width, target.height, target.layers);
+  // Later passes sample the result or attach it to a framebuffer
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "param_block.h"
+#include "render_pass.h"
+#include <memory>
+#include <string>
+
+// Mirrors the HistogramParams block in histogram.frag and histogram.comp
+struct HistogramParams {
+  GLVec2 gridCellDimensions;
+  int threshold;
+  int padding;
+};
+
+// Dominant edge direction per grid cell. Runs histogram.comp (a workgroup per
+// cell reducing into shared-memory bins) on GL 4.3 contexts and falls back to
+// the per-fragment histogram.frag on GL 3.3. Writes into an R8 target of
+// gridCols x gridRows. In temporal mode only the cells marked in a dirty mask
+// are rewritten. Layered, it reads and writes texture arrays and covers every
+// layer in one dispatch or draw.
+struct HistogramPass {
+  bool useCompute = false;
+
+  RenderPass fragmentPass; // Fallback path
+  std::unique_ptr<ShaderProgram> computeShader;
+  ParamBlock<HistogramParams> params;
+
+  void init(const std::string &shaderDir, bool allowCompute,
+            bool temporal = false, bool layered = false);
+  // dirtyTex: gridCols x gridRows mask of cells to recompute, temporal
+  // mode only
+  void run(GLuint edgeTex, GLuint vao, int threshold,
+           const RenderTarget &target, GLuint dirtyTex = 0);
+};
@@ -1,79 +1,386 @@
 #include <glad/gl.h>
 #include <GLFW/glfw3.h>
 #include <opencv2/opencv.hpp>
+#include "batch_scheduler.h"
+#include "cpu_engine.h"
+#include "frame_upload.h"
+#include "gl_ext.h"
+#include "headless_context.h"
+#include "options.h"
+#include "pipeline.h"
+#include "profiler.h"
+#include "readback.h"
+#include "shader_cache.h"
+#include "shader_compile_worker.h"
 #include "shader_utils.h"
-#include "render_pass.h"
+#include "shader_watcher.h"
+#include "video_pipeline.h"
 
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
 #include <iostream>
+#include <memory>
+
+static std::string outputFileFor(const Options &opts,
+                                 const std::string &inputPath,
+                                 const char *extension) {
+  std::filesystem::path in(inputPath);
+  std::filesystem::path out(opts.outputPath);
+  return (out / (in.stem().string() + "_ascii" + extension)).string();
+}
 
-// Fullscreen quad vertices (position + texcoord)
-float quadVertices[] = {
-    // positions  // texcoords
-    -1.0f, 1.0f,  0.0f, 1.0f,
-
-    -1.0f, -1.0f, 0.0f, 0.0f,
-
-    1.0f,  1.0f,  1.0f, 1.0f,
-
-    1.0f,  -1.0f, 1.0f, 0.0f,
-};
-
-GLuint createFullscreenQuadVAO() {
-  GLuint VAO, VBO;
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-
-  glBindVertexArray(VAO);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices,
-               GL_STATIC_DRAW);
+// Points ShaderProgram at the on-disk binary cache unless disabled. Needs a
+// current context
+static void initShaderCache(const Options &opts, ShaderCache &cache) {
+  if (!opts.useShaderCache)
+    return;
+  cache.init(opts.shaderCacheDir.empty() ? ShaderCache::defaultDirectory()
+                                         : opts.shaderCacheDir);
+  if (cache.enabled)
+    ShaderProgram::cache = &cache;
+}
 
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)0);
+// Builds every program the pipeline can ask for so later runs start from
+// cached binaries. Rather than guess which (stages, defines) pairings exist,
+// it initializes a small Pipeline in each configuration that changes them:
+// compute or fragment histogram, temporal, and batched (layered)
+static int warmCache(const Options &opts) {
+  HeadlessContext context;
+  if (!context.init())
+    return -1;
+  int glVersion = gladLoadGL(headlessGetProcAddress);
+  if (!glVersion) {
+    std::cerr << "Failed to initialize GLAD" << std::endl;
+    return -1;
+  }
+  loadGLExtensions(headlessGetProcAddress, glVersion);
 
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float),
-                        (void *)(2 * sizeof(float)));
+  ShaderCache cache;
+  initShaderCache(opts, cache);
+  if (!cache.enabled) {
+    std::cerr << "Shader cache unavailable, nothing to warm" << std::endl;
+    return 1;
+  }
 
-  return VAO;
+  int configurations = 0;
+  for (bool compute : {true, false}) {
+    if (compute && !glCaps.computeShaders)
+      continue;
+    for (bool temporal : {false, true}) {
+      for (int layers : {1, 2}) {
+        if (temporal && layers > 1)
+          continue; // Temporal mode doesn't batch
+        // Composite output needs no glyph atlas; every pass is still built
+        Pipeline pipeline;
+        pipeline.temporal = temporal;
+        pipeline.layers = layers;
+        pipeline.init(64, 64, 8, opts.shaderDir, compute,
+                      PipelineOutput::Composite);
+        configurations++;
+      }
+    }
+  }
+  std::cout << "Warmed " << configurations << " pipeline configuration(s) in "
+            << cache.directory << std::endl;
+  cache.printStats();
+  ShaderProgram::cache = nullptr;
+  return 0;
 }
 
-GLuint loadTextureFromImage(const cv::Mat &image) {
-  GLuint tex;
-  glGenTextures(1, &tex);
-  glBindTexture(GL_TEXTURE_2D, tex);
-
-  cv::Mat flipped;
-  cv::flip(image, flipped, 0); // OpenGL expects origin at bottom-left
+// Renders every input on the CPU engine and writes the results to disk, like
+// runHeadless. Used with --cpu and whenever no GL context is available
+static int runCpu(const Options &opts) {
+  if (opts.temporal)
+    std::cerr << "--temporal is GL only, the CPU engine renders every cell"
+              << std::endl;
+  if (opts.quality != QualityPreset::High || opts.targetFps > 0.0)
+    std::cerr << "--quality and --target-fps are GL only, the CPU engine "
+                 "always runs at full detail"
+              << std::endl;
+  Profiler profiler;
+  if (opts.profile)
+    Profiler::active = &profiler;
+  std::error_code ec;
+  std::filesystem::create_directories(opts.outputPath, ec);
+
+  GridWriter grid;
+  if (opts.gridFormat != GridFormat::None &&
+      !grid.open(opts.gridOut, opts.gridFormat))
+    return 1;
 
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, flipped.cols, flipped.rows, 0, GL_BGR,
-               GL_UNSIGNED_BYTE, flipped.data);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  CpuEngine engine;
+  bool engineReady = false;
+  int written = 0;
+  int frames = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (const std::string &input : opts.inputs) {
+    if (isVideoFile(input)) {
+      if (!engineReady) {
+        engine.glyphStyle = opts.glyphStyle;
+        engine.init(1, 1, opts.gridCols, opts.threads);
+        engineReady = true;
+      }
+      int videoFrames = processVideoCpu(
+          input, outputFileFor(opts, input, ".mp4"), opts, engine,
+          grid.format != GridFormat::None ? &grid : nullptr);
+      if (videoFrames >= 0) {
+        written++;
+        frames += videoFrames;
+      }
+      continue;
+    }
+
+    cv::Mat inputImage;
+    {
+      ProfileSpan span("decode");
+      inputImage = cv::imread(input);
+    }
+    if (inputImage.empty()) {
+      std::cerr << "Failed to load input image: " << input << std::endl;
+      continue;
+    }
+    if (!engineReady) {
+      engine.glyphStyle = opts.glyphStyle;
+      engine.init(inputImage.cols, inputImage.rows, opts.gridCols,
+                  opts.threads);
+      engineReady = true;
+    }
+    cv::Mat result;
+    if (grid.format != GridFormat::None) {
+      engine.runGrid(inputImage, result, opts.gridColor);
+      ProfileSpan span("encode");
+      grid.setGlyphs(engine.atlas.glyphs);
+      if (grid.write(result.data, result.cols, result.rows,
+                     result.channels())) {
+        written++;
+        frames++;
+      }
+    } else {
+      if (opts.ascii)
+        engine.runAscii(inputImage, result);
+      else
+        engine.run(inputImage, result);
+
+      std::string outPath = outputFileFor(opts, input, ".png");
+      ProfileSpan span("encode");
+      if (cv::imwrite(outPath, result)) {
+        written++;
+        frames++;
+      } else {
+        std::cerr << "Failed to write " << outPath << std::endl;
+      }
+    }
+    if (Profiler::active)
+      profiler.endFrame();
+  }
 
-  return tex;
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  std::cout << "Rendered " << frames << " frame(s) from " << written << "/"
+            << opts.inputs.size() << " input(s) on the CPU in " << seconds
+            << " s (" << (seconds > 0 ? frames / seconds : 0.0) << " fps)"
+            << std::endl;
+  if (Profiler::active)
+    profiler.finish(opts.profileOut);
+  Profiler::active = nullptr;
+  return written == (int)opts.inputs.size() ? 0 : 1;
 }
 
-int main(int argc, char **argv) {
-  std::cout << R"(
-    ______   ______  ______   __  __   __  __   __    
-   /\  __ \ /\__  _\/\  ___\ /\ \/\ \ /\ \/ /  /\ \   
-   \ \  __ \\/_/\ \/\ \___  \\ \ \_\ \\ \  _"-.\ \ \  
-    \ \_\ \_\  \ \_\ \/\_____\\ \_____\\ \_\ \_\\ \_\ 
-     \/_/\/_/   \/_/  \/_____/ \/_____/ \/_/\/_/ \/_/ 
-         ASCII  EFFECT  FILTER  FOR  YOUR  VIDEOS
-  )" << std::endl;
-
-  if (argc < 3) {
-    std::cerr << "Usage: " << argv[0] << " <input_image_path> <shader_dir>\n";
-    return 1;
+// Runs the pipeline once per input and writes each result to disk. Readbacks
+// go through a PBO ring so input N+1 is uploaded and rendered while input N is
+// still being copied back. Videos are handed to processVideo. With --batch,
+// images are grouped by size and each run renders a whole group, one input
+// per texture array layer.
+static int runHeadless(const Options &opts) {
+  HeadlessContext context;
+  if (!context.init()) {
+    std::cerr << "No GL context, falling back to the CPU engine" << std::endl;
+    return runCpu(opts);
+  }
+  int glVersion = gladLoadGL(headlessGetProcAddress);
+  if (!glVersion) {
+    std::cerr << "Failed to initialize GLAD, falling back to the CPU engine"
+              << std::endl;
+    return runCpu(opts);
   }
+  loadGLExtensions(headlessGetProcAddress, glVersion);
+  std::cout << "Renderer: " << glGetString(GL_RENDERER) << std::endl;
+  ShaderCache cache;
+  initShaderCache(opts, cache);
+  Profiler profiler;
+  if (opts.profile)
+    Profiler::active = &profiler;
+
+  std::error_code ec;
+  std::filesystem::create_directories(opts.outputPath, ec);
+  GridWriter grid;
+  if (opts.gridFormat != GridFormat::None &&
+      !grid.open(opts.gridOut, opts.gridFormat))
+    return 1;
 
-  std::string inputPath = argv[1];
-  std::string shaderDir = argv[2];
+  std::unique_ptr<Pipeline> pipeline;
+  std::unique_ptr<FrameUploader> uploader;
+  std::unique_ptr<ReadbackRing> readback;
+  int written = 0; // Inputs fully processed
+  int frames = 0;  // Frames rendered, counting every frame of a video
+
+  auto writeReady = [&](bool wait) {
+    cv::Mat result;
+    int index;
+    while (readback && readback->dequeue(result, index, wait)) {
+      // Not written, so the run reports failure
+      if (result.empty()) {
+        std::cerr << "Failed to read back " << opts.inputs[index] << std::endl;
+        continue;
+      }
+      ProfileSpan span("encode");
+      if (grid.format != GridFormat::None) {
+        // Grids still queued were rendered before any resize: resizes wait
+        // for the ring to drain
+        grid.setGlyphs(pipeline->atlas.glyphs);
+        if (grid.write(result.data, result.cols, result.rows,
+                       result.channels())) {
+          written++;
+          frames++;
+        }
+        continue;
+      }
+      std::string outPath = outputFileFor(opts, opts.inputs[index], ".png");
+      if (cv::imwrite(outPath, result)) {
+        written++;
+        frames++;
+      } else {
+        std::cerr << "Failed to write " << outPath << std::endl;
+      }
+    }
+  };
+
+  // Layers past the array limit would fail to allocate
+  GLint maxLayers = 1;
+  glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+  int layers = std::min(opts.batch, (int)maxLayers);
+  if (layers < opts.batch)
+    std::cerr << "Batches limited to " << layers << " layers" << std::endl;
+  // Grids go to one stream, so they must come out in input order
+  BatchScheduler scheduler;
+  scheduler.maxLayers = layers;
+  // Inputs of many sizes would otherwise all stay decoded until the end
+  scheduler.maxAge = 4 * layers;
+  scheduler.keepOrder = grid.format != GridFormat::None;
+
+  auto renderBatch = [&](const Batch &batch) {
+    // Render targets are sized to the input; on a size change the graph
+    // only reallocates the targets that actually differ
+    if (!pipeline) {
+      pipeline = std::make_unique<Pipeline>();
+      pipeline->glyphStyle = opts.glyphStyle;
+      pipeline->temporal = opts.temporal;
+      pipeline->changeTolerance = opts.changeTolerance;
+      pipeline->layers = layers;
+      // Single frames: nothing to govern, only the preset applies
+      pipeline->edgeDownsample = presetDownsample(opts.quality);
+      pipeline->init(batch.width, batch.height, opts.gridCols, opts.shaderDir,
+                     opts.allowCompute, headlessOutput(opts));
+      cache.printStats();
+    } else if (pipeline->width != batch.width ||
+               pipeline->height != batch.height) {
+      writeReady(true);
+      pipeline->resize(batch.width, batch.height, opts.gridCols);
+    }
+    if (!uploader || uploader->width != batch.width ||
+        uploader->height != batch.height) {
+      readback.reset();
+      uploader.reset();
+      uploader = std::make_unique<FrameUploader>();
+      uploader->init(batch.width, batch.height, PixelFormat::BGR, 3, layers);
+      // Grid output reads back only the grid, not the frame. Room for two
+      // batches, so one is copied back while the next renders
+      RenderTarget out = pipeline->output();
+      readback = std::make_unique<ReadbackRing>();
+      readback->init(out.width, out.height, std::max(3, 2 * layers),
+                     pipeline->readbackFormat());
+    }
+
+    // A partial batch leaves its last layers stale; they are never read
+    for (size_t layer = 0; layer < batch.jobs.size(); layer++)
+      uploader->uploadImage(batch.jobs[layer].image, (int)layer);
+    pipeline->run(*uploader);
+
+    RenderTarget out = pipeline->output();
+    for (size_t layer = 0; layer < batch.jobs.size(); layer++) {
+      if (readback->full())
+        writeReady(true);
+      if (layers > 1)
+        readback->enqueueLayer(out.texture, (int)layer, batch.jobs[layer].tag);
+      else
+        readback->enqueue(out.fbo, batch.jobs[layer].tag);
+    }
+    writeReady(false);
+    if (Profiler::active)
+      profiler.endFrame();
+  };
+  auto flushBatches = [&] {
+    Batch batch;
+    while (scheduler.next(batch, true))
+      renderBatch(batch);
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < opts.inputs.size(); i++) {
+    if (isVideoFile(opts.inputs[i])) {
+      // Earlier images' grids go first
+      if (grid.format != GridFormat::None) {
+        flushBatches();
+        writeReady(true);
+      }
+      std::string outPath = outputFileFor(opts, opts.inputs[i], ".mp4");
+      int videoFrames = processVideo(
+          opts.inputs[i], outPath, opts,
+          grid.format != GridFormat::None ? &grid : nullptr);
+      if (videoFrames >= 0) {
+        written++;
+        frames += videoFrames;
+      }
+      continue;
+    }
+
+    cv::Mat inputImage;
+    {
+      ProfileSpan span("decode");
+      inputImage = cv::imread(opts.inputs[i]);
+    }
+    if (inputImage.empty()) {
+      std::cerr << "Failed to load input image: " << opts.inputs[i]
+                << std::endl;
+      continue;
+    }
+
+    scheduler.add((int)i, inputImage);
+    Batch batch;
+    while (scheduler.next(batch, false))
+      renderBatch(batch);
+  }
+  flushBatches();
+  writeReady(true);
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  std::cout << "Rendered " << frames << " frame(s) from " << written << "/"
+            << opts.inputs.size() << " input(s) in " << seconds << " s ("
+            << (seconds > 0 ? frames / seconds : 0.0) << " fps)" << std::endl;
+  if (Profiler::active)
+    profiler.finish(opts.profileOut);
+  Profiler::active = nullptr;
+  ShaderProgram::cache = nullptr;
+  return written == (int)opts.inputs.size() ? 0 : 1;
+}
 
+static int runWindowed(const Options &opts) {
   // Load image using OpenCV
-  cv::Mat inputImage = cv::imread(inputPath);
+  cv::Mat inputImage = cv::imread(opts.inputs[0]);
   if (inputImage.empty()) {
     std::cerr << "Failed to load input image" << std::endl;
     return -1;
@@ -81,14 +388,11 @@ int main(int argc, char **argv) {
   int renderWidth = inputImage.cols;
   int renderHeight = inputImage.rows;
 
-  int gridCols = 160; // Can play with this
-  float imageAspect = (float)renderWidth / renderHeight;
-  int gridRows =
-      static_cast<int>(gridCols / imageAspect + 0.5f); // Round to nearest
-
+  // Without a display there is nothing to show; write the result instead
   if (!glfwInit()) {
-    std::cerr << "Failed to initialize GLFW" << std::endl;
-    return -1;
+    std::cerr << "Failed to initialize GLFW, rendering to " << opts.outputPath
+              << " on the CPU" << std::endl;
+    return runCpu(opts);
   }
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -97,69 +401,162 @@ int main(int argc, char **argv) {
   GLFWwindow *window =
       glfwCreateWindow(renderWidth, renderHeight, "ATSUKI", nullptr, nullptr);
   if (!window) {
-    std::cerr << "Failed to create GLFW window" << std::endl;
+    std::cerr << "Failed to create GLFW window, rendering to "
+              << opts.outputPath << " on the CPU" << std::endl;
     glfwTerminate();
-    return -1;
+    return runCpu(opts);
   }
   glfwMakeContextCurrent(window);
   glfwSetWindowAspectRatio(window, renderWidth, renderHeight);
 
-  if (!gladLoadGL(glfwGetProcAddress)) {
+  int glVersion = gladLoadGL(glfwGetProcAddress);
+  if (!glVersion) {
     std::cerr << "Failed to initialize GLAD" << std::endl;
     return -1;
   }
-
-  GLuint quadVAO = createFullscreenQuadVAO();
-  GLuint inputTex = loadTextureFromImage(inputImage);
-
-  // Setup render passes
-  RenderPass edgePass, histPass, asciiPass;
-  edgePass.init(renderWidth, renderHeight, shaderDir + "/fullscreen_quad.vert",
-                shaderDir + "/edge_detect.frag");
-  histPass.init(gridCols, gridRows, shaderDir + "/fullscreen_quad.vert",
-                shaderDir + "/histogram.frag");
-  asciiPass.init(renderWidth, renderHeight, shaderDir + "/fullscreen_quad.vert",
-                 shaderDir + "/ascii_render.frag");
-
-  // Display pass (simple passthrough shader)
-  ShaderProgram displayShader(shaderDir + "/fullscreen_quad.vert",
-                              shaderDir + "/display.frag");
-
-  while (!glfwWindowShouldClose(window)) {
-    glfwPollEvents();
-
-    edgePass.run(inputTex, quadVAO, [&](GLuint program) {
-      glUniform1f(glGetUniformLocation(program, "u_threshold"), 0.2f);
-      glUniform2f(glGetUniformLocation(program, "u_textureSize"),
-                  (float)renderWidth, (float)renderHeight);
-    });
-
-    histPass.run(edgePass.texture, quadVAO, [&](GLuint program) {
-      glUniform2f(glGetUniformLocation(program, "u_gridCellDimensions"),
-                  gridCols, gridRows);
-      glUniform1i(glGetUniformLocation(program, "u_threshold"), 10);
-    });
-
-    // Final display
-    int fbWidth, fbHeight;
-    glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glViewport(0, 0, fbWidth, fbHeight);
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    displayShader.reloadIfChanged();
-    glUseProgram(displayShader.id);
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, histPass.texture);
-    glUniform1i(glGetUniformLocation(displayShader.id, "image"), 0);
-
-    glBindVertexArray(quadVAO);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-
-    glfwSwapBuffers(window);
+  loadGLExtensions(glfwGetProcAddress, glVersion);
+  ShaderCache cache;
+  initShaderCache(opts, cache);
+  // Hot reload is for interactive tweaking; batch runs don't watch sources
+  ShaderWatcher watcher;
+  if (watcher.start())
+    ShaderProgram::watcher = &watcher;
+  // Without parallel compile, reloads build on a hidden window whose context
+  // shares objects with this one
+  GLFWwindow *compileWindow = nullptr;
+  auto compileWorker = std::make_unique<ShaderCompileWorker>();
+  if (ShaderProgram::watcher && !glCaps.parallelShaderCompile) {
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    compileWindow = glfwCreateWindow(1, 1, "ATSUKI shaders", nullptr, window);
+    if (compileWindow &&
+        compileWorker->start(
+            [compileWindow] {
+              glfwMakeContextCurrent(compileWindow);
+              return true;
+            },
+            [] { glfwMakeContextCurrent(nullptr); })) {
+      ShaderProgram::compileWorker = compileWorker.get();
+      std::cout << "No KHR_parallel_shader_compile: shader reloads build on "
+                   "a shared context"
+                << std::endl;
+    } else {
+      std::cerr << "No KHR_parallel_shader_compile and no shared context: "
+                   "shader reloads will block rendering"
+                << std::endl;
+    }
   }
-
+  Profiler profiler;
+  if (opts.profile)
+    Profiler::active = &profiler;
+
+  {
+    FrameUploader uploader;
+    uploader.init(renderWidth, renderHeight, PixelFormat::BGR, 1);
+    uploader.uploadImage(inputImage);
+
+    // Setup render passes
+    QualityGovernor governor;
+    if (opts.targetFps > 0.0)
+      governor.targetMs = 1000.0 / opts.targetFps;
+    governor.init(renderWidth, renderHeight, opts.minGridCols, opts.gridCols,
+                  opts.quality);
+
+    Pipeline pipeline;
+    pipeline.glyphStyle = opts.glyphStyle;
+    pipeline.temporal = opts.temporal;
+    pipeline.changeTolerance = opts.changeTolerance;
+    pipeline.edgeDownsample = governor.current().edgeDownsample;
+    pipeline.init(renderWidth, renderHeight, governor.current().gridCols,
+                  opts.shaderDir, opts.allowCompute,
+                  opts.ascii ? PipelineOutput::Ascii : PipelineOutput::Cells);
+
+    // Display pass (simple passthrough shader). The ASCII image is top-down
+    ShaderProgram displayShader(opts.shaderDir + "/fullscreen_quad.vert",
+                                opts.shaderDir + "/display.frag");
+    displayShader.setFixedUniform("u_texture", 0);
+    displayShader.setFixedUniform("u_flipY", opts.ascii ? 1 : 0);
+    cache.printStats();
+
+    while (!glfwWindowShouldClose(window)) {
+      glfwPollEvents();
+
+      QualityLevel level;
+      if (governor.update(level))
+        pipeline.setQuality(level.edgeDownsample, level.gridCols);
+      governor.beginFrame();
+      pipeline.run(uploader);
+      governor.endFrame();
+
+      // Final display
+      int fbWidth, fbHeight;
+      glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      glViewport(0, 0, fbWidth, fbHeight);
+      glClear(GL_COLOR_BUFFER_BIT);
+
+      displayShader.reloadIfChanged();
+      glUseProgram(displayShader.id);
+
+      glActiveTexture(GL_TEXTURE0);
+      glBindTexture(GL_TEXTURE_2D, pipeline.output().texture);
+
+      if (Profiler::active)
+        profiler.beginGpu("display");
+      glBindVertexArray(pipeline.quadVAO);
+      glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+      if (Profiler::active)
+        profiler.endGpu();
+
+      {
+        ProfileSpan span("swap");
+        glfwSwapBuffers(window);
+      }
+      if (Profiler::active)
+        profiler.endFrame();
+    }
+  } // GL objects must be released while the context is still alive
+
+  if (Profiler::active)
+    profiler.finish(opts.profileOut);
+  Profiler::active = nullptr;
+
+  // Programs are gone; finish their queued discards before the context goes
+  compileWorker.reset();
+  ShaderProgram::compileWorker = nullptr;
+  if (compileWindow)
+    glfwDestroyWindow(compileWindow);
+  ShaderProgram::cache = nullptr;
+  ShaderProgram::watcher = nullptr;
   glfwTerminate();
   return 0;
 }
+
+int main(int argc, char **argv) {
+  Options opts;
+  if (!parseOptions(argc, argv, opts)) {
+    printUsage(argv[0]);
+    return 1;
+  }
+  // stdout carries the grid; keep logs out of it
+  if (opts.gridFormat != GridFormat::None && opts.gridOut == "-")
+    std::cout.rdbuf(std::cerr.rdbuf());
+
+  std::cout << R"(
+    ______   ______  ______   __  __   __  __   __
+   /\  __ \ /\__  _\/\  ___\ /\ \/\ \ /\ \/ /  /\ \
+   \ \  __ \\/_/\ \/\ \___  \\ \ \_\ \\ \  _"-.\ \ \
+    \ \_\ \_\  \ \_\ \/\_____\\ \_____\\ \_\ \_\\ \_\
+     \/_/\/_/   \/_/  \/_____/ \/_____/ \/_/\/_/ \/_/
+         ASCII  EFFECT  FILTER  FOR  YOUR  VIDEOS
+  )" << std::endl;
+
+  if (opts.warmCache)
+    return warmCache(opts);
+
+  // Videos are batch jobs: always render them offscreen
+  if (isVideoFile(opts.inputs[0]))
+    opts.headless = true;
+  if (opts.cpu)
+    return runCpu(opts);
+  return opts.headless ? runHeadless(opts) : runWindowed(opts);
+}
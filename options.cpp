@@ -0,0 +1,278 @@
+#include "options.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+void printUsage(const char *argv0) {
+  std::cerr
+      << "Usage: " << argv0
+      << " <input_image_path> <shader_dir> [options] [more_inputs...]\n"
+      << "       " << argv0
+      << " warm-cache <shader_dir> [--shader-cache <dir>]\n"
+      << "Options:\n"
+      << "  --headless         Render offscreen and write results to disk\n"
+      << "  -o, --output <dir> Output directory for --headless (default: .)\n"
+      << "  --grid-cols <n>    Number of ASCII columns (default: 160)\n"
+      << "  --queue-depth <n>  Frames buffered between video stages "
+         "(default: 4)\n"
+      << "  --input-format <f> Video decode layout: bgr, nv12 or i420 "
+         "(default: bgr).\n"
+      << "                     Decoders that don't report their pixel format\n"
+      << "                     are trusted: a wrong nv12/i420 choice then\n"
+      << "                     gives wrong colours\n"
+      << "  --no-compute       Use the GL 3.3 fragment shader fallbacks\n"
+      << "  --shader-cache <d> Program binary cache directory (default:\n"
+      << "                     $XDG_CACHE_HOME/atsuki/shaders)\n"
+      << "  --no-shader-cache  Always compile shaders from source\n"
+      << "  --profile          Print per-stage p50/p95/p99 timings\n"
+      << "  --profile-out <f>  Also write them to f (.json or .csv) on exit\n"
+      << "  --cpu              Render on the CPU (used anyway when GL fails)\n"
+      << "  --threads <n>      CPU render threads (default: all cores)\n"
+      << "  --grid <f>         Emit the character grid as text, ansi or\n"
+      << "                     binary instead of images (implies --headless)\n"
+      << "  --grid-out <file>  Grid destination (default: - for stdout)\n"
+      << "  --grid-color       Include cell colours in binary grids\n"
+      << "  --ascii            Render coloured glyphs instead of edge cells\n"
+      << "  --charset <chars>  Brightness glyphs, in any order (default:\n"
+      << "                     \" .:-=+*#%@\")\n"
+      << "  --font <name>      Hershey font: simplex (default), plain,\n"
+      << "                     duplex, complex, triplex, complex-small,\n"
+      << "                     script-simplex or script-complex\n"
+      << "  --atlas-cache <d>  Glyph atlas cache directory (default:\n"
+      << "                     $XDG_CACHE_HOME/atsuki/atlases)\n"
+      << "  --no-atlas-cache   Always rasterize glyph atlases\n"
+      << "  --temporal         Only recompute cells that changed since the\n"
+      << "                     previous frame (for mostly static footage)\n"
+      << "  --change-tolerance <l>\n"
+      << "                     Block change in 8-bit levels that still counts\n"
+      << "                     as unchanged (default: 2, implies --temporal)\n"
+      << "  --quality <p>      Starting detail: high (default), balanced or\n"
+      << "                     fast (edge detection at 1, 1/2 or 1/4 size)\n"
+      << "  --target-fps <n>   Lower the quality while the GPU can't keep up\n"
+      << "                     with n frames per second, and raise it again\n"
+      << "                     once it can\n"
+      << "  --min-grid-cols <n>\n"
+      << "                     Fewest columns --target-fps may drop to\n"
+      << "                     (default: --grid-cols, i.e. never)\n"
+      << "  --batch <n>        Render up to n same-sized images at once, as\n"
+      << "                     layers of one texture array (default: 1).\n"
+      << "                     Videos still render one stream at a time\n"
+      << "Video inputs (.mp4, .mov, .mkv, ...) always render headless and are\n"
+      << "written to <output>/<name>_ascii.mp4\n";
+}
+
+bool parseOptions(int argc, char **argv, Options &opts) {
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    // Flags that take a value
+    auto value = [&](const char *flag) -> const char * {
+      if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << flag << std::endl;
+        return nullptr;
+      }
+      return argv[++i];
+    };
+
+    if (std::strcmp(arg, "--headless") == 0) {
+      opts.headless = true;
+    } else if (std::strcmp(arg, "--no-compute") == 0) {
+      opts.allowCompute = false;
+    } else if (std::strcmp(arg, "--cpu") == 0) {
+      opts.cpu = true;
+    } else if (std::strcmp(arg, "--threads") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      opts.threads = std::atoi(v);
+      if (opts.threads <= 0) {
+        std::cerr << "--threads must be positive" << std::endl;
+        return false;
+      }
+    } else if (std::strcmp(arg, "--grid") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      if (std::strcmp(v, "text") == 0) {
+        opts.gridFormat = GridFormat::Text;
+      } else if (std::strcmp(v, "ansi") == 0) {
+        opts.gridFormat = GridFormat::Ansi;
+      } else if (std::strcmp(v, "binary") == 0) {
+        opts.gridFormat = GridFormat::Binary;
+      } else {
+        std::cerr << "Unknown --grid format: " << v << std::endl;
+        return false;
+      }
+      opts.headless = true;
+    } else if (std::strcmp(arg, "--grid-out") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      opts.gridOut = v;
+    } else if (std::strcmp(arg, "--grid-color") == 0) {
+      opts.gridColor = true;
+    } else if (std::strcmp(arg, "--ascii") == 0) {
+      opts.ascii = true;
+    } else if (std::strcmp(arg, "--charset") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      size_t length = std::strlen(v);
+      if (length == 0 || length > (size_t)kMaxCharsetLength) {
+        std::cerr << "--charset needs 1 to " << kMaxCharsetLength
+                  << " characters" << std::endl;
+        return false;
+      }
+      opts.glyphStyle.charset = v;
+    } else if (std::strcmp(arg, "--font") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      opts.glyphStyle.font = hersheyFontFromName(v);
+      if (opts.glyphStyle.font < 0) {
+        std::cerr << "Unknown --font: " << v << std::endl;
+        return false;
+      }
+    } else if (std::strcmp(arg, "--no-atlas-cache") == 0) {
+      opts.glyphStyle.useCache = false;
+    } else if (std::strcmp(arg, "--atlas-cache") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      opts.glyphStyle.cacheDir = v;
+    } else if (std::strcmp(arg, "--temporal") == 0) {
+      opts.temporal = true;
+    } else if (std::strcmp(arg, "--change-tolerance") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      opts.changeTolerance = (float)std::atof(v);
+      if (opts.changeTolerance < 0.0f) {
+        std::cerr << "--change-tolerance must not be negative" << std::endl;
+        return false;
+      }
+      opts.temporal = true;
+    } else if (std::strcmp(arg, "--quality") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      if (!qualityPresetFromName(v, opts.quality)) {
+        std::cerr << "Unknown --quality: " << v << std::endl;
+        return false;
+      }
+    } else if (std::strcmp(arg, "--target-fps") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      opts.targetFps = std::atof(v);
+      if (opts.targetFps <= 0.0) {
+        std::cerr << "--target-fps must be positive" << std::endl;
+        return false;
+      }
+    } else if (std::strcmp(arg, "--min-grid-cols") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      opts.minGridCols = std::atoi(v);
+      if (opts.minGridCols <= 0) {
+        std::cerr << "--min-grid-cols must be positive" << std::endl;
+        return false;
+      }
+    } else if (std::strcmp(arg, "--batch") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      opts.batch = std::atoi(v);
+      if (opts.batch <= 0) {
+        std::cerr << "--batch must be positive" << std::endl;
+        return false;
+      }
+    } else if (std::strcmp(arg, "--profile") == 0) {
+      opts.profile = true;
+    } else if (std::strcmp(arg, "--profile-out") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      opts.profile = true;
+      opts.profileOut = v;
+    } else if (std::strcmp(arg, "--no-shader-cache") == 0) {
+      opts.useShaderCache = false;
+    } else if (std::strcmp(arg, "--shader-cache") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      opts.shaderCacheDir = v;
+    } else if (std::strcmp(arg, "-o") == 0 ||
+               std::strcmp(arg, "--output") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      opts.outputPath = v;
+    } else if (std::strcmp(arg, "--grid-cols") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      opts.gridCols = std::atoi(v);
+      if (opts.gridCols <= 0) {
+        std::cerr << "--grid-cols must be positive" << std::endl;
+        return false;
+      }
+    } else if (std::strcmp(arg, "--queue-depth") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      opts.queueDepth = std::atoi(v);
+      if (opts.queueDepth <= 0) {
+        std::cerr << "--queue-depth must be positive" << std::endl;
+        return false;
+      }
+    } else if (std::strcmp(arg, "--input-format") == 0) {
+      const char *v = value(arg);
+      if (!v)
+        return false;
+      if (std::strcmp(v, "bgr") == 0) {
+        opts.inputFormat = PixelFormat::BGR;
+      } else if (std::strcmp(v, "nv12") == 0) {
+        opts.inputFormat = PixelFormat::NV12;
+      } else if (std::strcmp(v, "i420") == 0) {
+        opts.inputFormat = PixelFormat::I420;
+      } else {
+        std::cerr << "Unknown --input-format: " << v << std::endl;
+        return false;
+      }
+    } else if (arg[0] == '-' && arg[1] != '\0') {
+      std::cerr << "Unknown option: " << arg << std::endl;
+      return false;
+    } else {
+      positional.push_back(arg);
+    }
+  }
+
+  if (!positional.empty() && positional[0] == "warm-cache") {
+    if (positional.size() != 2)
+      return false;
+    opts.warmCache = true;
+    opts.shaderDir = positional[1];
+    return true;
+  }
+
+  if (positional.size() < 2)
+    return false;
+  opts.inputs.push_back(positional[0]);
+  opts.shaderDir = positional[1];
+  for (size_t i = 2; i < positional.size(); i++)
+    opts.inputs.push_back(positional[i]);
+
+  if (opts.gridFormat == GridFormat::Ansi)
+    opts.gridColor = true;
+  else if (opts.gridFormat == GridFormat::Text)
+    opts.gridColor = false;
+  if (opts.minGridCols == 0 || opts.minGridCols > opts.gridCols)
+    opts.minGridCols = opts.gridCols;
+  if (opts.inputs.size() > 1 && !opts.headless) {
+    std::cerr << "Multiple inputs are only supported with --headless"
+              << std::endl;
+    return false;
+  }
+  return true;
+}
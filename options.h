@@ -0,0 +1,67 @@
+#pragma once
+#include "frame_upload.h"
+#include "glyph_atlas.h"
+#include "grid_output.h"
+#include "quality_governor.h"
+#include <string>
+#include <vector>
+
+struct Options {
+  std::vector<std::string> inputs; // First positional argument plus extras
+  std::string shaderDir;
+  int gridCols = 160; // Can play with this
+
+  // Render offscreen (EGL) and write results to outputPath instead of
+  // opening a window
+  bool headless = false;
+  std::string outputPath = ".";
+  // Frames buffered between video decode, render and encode stages
+  int queueDepth = 4;
+  // Raw layout to request from the video decoder. YUV skips OpenCV's BGR
+  // conversion; the first shader pass converts instead
+  PixelFormat inputFormat = PixelFormat::BGR;
+  // Use compute shaders when the context has GL 4.3; off forces the GL 3.3
+  // fragment fallbacks
+  bool allowCompute = true;
+  // Persistent program binary cache. Empty dir means
+  // ShaderCache::defaultDirectory()
+  bool useShaderCache = true;
+  std::string shaderCacheDir;
+  // "atsuki warm-cache <shader_dir>": build every shader into the cache and
+  // exit
+  bool warmCache = false;
+  // Per-stage GPU/CPU timings: periodic console summary, plus a .json or
+  // .csv report on exit when profileOut is set
+  bool profile = false;
+  std::string profileOut;
+  // Run the whole effect on the CPU engine instead of GL. Also the fallback
+  // when no GL context can be created
+  bool cpu = false;
+  int threads = 0; // CPU engine workers, 0 = one per hardware thread
+  // Emit the character grid instead of images: only the gridCols x
+  // gridRows target is read back. gridOut "-" is stdout
+  GridFormat gridFormat = GridFormat::None;
+  std::string gridOut = "-";
+  bool gridColor = false; // Cell colours in binary output (ANSI always)
+  // Draw glyphs from the atlas instead of the edge-direction composite
+  bool ascii = false;
+  GlyphStyle glyphStyle; // Charset, font and atlas cache
+  // Recompute only the cells whose input changed since the previous frame
+  // (GL only). changeTolerance: block mean change, in 8-bit levels, below
+  // which a cell counts as unchanged, so compression noise is ignored
+  bool temporal = false;
+  float changeTolerance = 2.0f;
+  // Starting speed/detail trade-off (GL only). With targetFps set, a
+  // QualityGovernor then moves between levels to hold that rate, using grid
+  // column counts between minGridCols (0 = gridCols, i.e. fixed) and gridCols
+  QualityPreset quality = QualityPreset::High;
+  double targetFps = 0.0;
+  int minGridCols = 0;
+  // Headless still images: render up to batch inputs of the same size in
+  // one pipeline run, as layers of texture arrays. 1 renders one at a time
+  int batch = 1;
+};
+
+void printUsage(const char *argv0);
+// Returns false (after printing why) if the command line is unusable
+bool parseOptions(int argc, char **argv, Options &opts);
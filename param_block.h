@@ -0,0 +1,84 @@
+#pragma once
+#include <glad/gl.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+// Uniform buffer binding points, one per parameter block type. Programs are
+// pointed at these with ShaderProgram::bindBlock
+enum ParamBinding : GLuint {
+  EdgeParamsBinding = 0,
+  HistogramParamsBinding = 1,
+  GridParamsBinding = 2,
+  AsciiParamsBinding = 3,
+  ChangeParamsBinding = 4,
+};
+
+// std140 vec2: 8-byte aligned, unlike a plain pair of floats
+struct alignas(8) GLVec2 {
+  float x, y;
+};
+
+// Typed CPU copy of a std140 uniform block plus the buffer backing it.
+// set() only records a change when the value actually differs, and bind()
+// uploads just the byte range touched since the last upload, so a pass whose
+// parameters are steady costs a single glBindBufferBase per frame.
+//
+// T must mirror the GLSL block member for member, padded to 16 bytes.
+template <typename T> struct ParamBlock {
+  static_assert(sizeof(T) % 16 == 0, "std140 blocks are padded to 16 bytes");
+
+  T values = {};
+  GLuint ubo = 0;
+  GLuint binding = 0;
+
+  ParamBlock() = default;
+  ParamBlock(const ParamBlock &) = delete;
+  ParamBlock &operator=(const ParamBlock &) = delete;
+
+  // Needs a current context
+  void init(GLuint bindingPoint) {
+    this->binding = bindingPoint;
+    glGenBuffers(1, &this->ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, this->ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(T), &this->values,
+                 GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    this->dirtyBegin = sizeof(T);
+    this->dirtyEnd = 0;
+  }
+
+  template <typename F> void set(F T::*field, const F &value) {
+    F &current = this->values.*field;
+    if (std::memcmp(&current, &value, sizeof(F)) == 0)
+      return;
+    std::memcpy(&current, &value, sizeof(F));
+    size_t offset = reinterpret_cast<const char *>(&current) -
+                    reinterpret_cast<const char *>(&this->values);
+    this->dirtyBegin = std::min(this->dirtyBegin, offset);
+    this->dirtyEnd = std::max(this->dirtyEnd, offset + sizeof(F));
+  }
+
+  // Uploads pending changes and binds the buffer to its binding point
+  void bind() {
+    if (this->dirtyBegin < this->dirtyEnd) {
+      glBindBuffer(GL_UNIFORM_BUFFER, this->ubo);
+      glBufferSubData(GL_UNIFORM_BUFFER, this->dirtyBegin,
+                      this->dirtyEnd - this->dirtyBegin,
+                      reinterpret_cast<const char *>(&this->values) +
+                          this->dirtyBegin);
+      glBindBuffer(GL_UNIFORM_BUFFER, 0);
+      this->dirtyBegin = sizeof(T);
+      this->dirtyEnd = 0;
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, this->binding, this->ubo);
+  }
+
+  ~ParamBlock() {
+    if (this->ubo)
+      glDeleteBuffers(1, &this->ubo);
+  }
+
+private:
+  size_t dirtyBegin = sizeof(T), dirtyEnd = 0; // Bytes changed since upload
+};
@@ -0,0 +1,443 @@
+#include "pipeline.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Fullscreen quad vertices (position + texcoord)
+static const float quadVertices[] = {
+    // positions  // texcoords
+    -1.0f, 1.0f,  0.0f, 1.0f,
+
+    -1.0f, -1.0f, 0.0f, 0.0f,
+
+    1.0f,  1.0f,  1.0f, 1.0f,
+
+    1.0f,  -1.0f, 1.0f, 0.0f,
+};
+
+GLuint createFullscreenQuadVAO(GLuint *vboOut) {
+  GLuint VAO, VBO;
+  glGenVertexArrays(1, &VAO);
+  glGenBuffers(1, &VBO);
+
+  glBindVertexArray(VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices,
+               GL_STATIC_DRAW);
+
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)0);
+
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float),
+                        (void *)(2 * sizeof(float)));
+
+  if (vboOut)
+    *vboOut = VBO;
+  return VAO;
+}
+
+int gridRowsFor(int w, int h, int cols) {
+  float imageAspect = (float)w / h;
+  return static_cast<int>(cols / imageAspect + 0.5f); // Round to nearest
+}
+
+int maxEdgeDownsample(int w, int h, int cols) {
+  int cellW = w / cols;
+  int cellH = h / std::max(1, gridRowsFor(w, h, cols));
+  return std::max(1, std::min(cellW, cellH) / 4);
+}
+
+void Pipeline::init(int w, int h, int cols, const std::string &shaderDir,
+                    bool allowCompute, PipelineOutput output) {
+  this->width = w;
+  this->height = h;
+  this->gridCols = cols;
+  // Very wide inputs round to no rows at all
+  this->gridRows = std::max(1, gridRowsFor(w, h, cols));
+  this->outputKind = output;
+  if (this->layers > 1 && this->temporal) {
+    std::cerr << "Temporal mode doesn't batch, recomputing every cell"
+              << std::endl;
+    this->temporal = false;
+  }
+  std::string defines = this->layers > 1 ? layeredDefines() : "";
+
+  this->quadVAO = createFullscreenQuadVAO(&this->quadVBO);
+  // In temporal mode the incremental passes draw one quad per dirty cell
+  // (cell_quad.vert) instead of covering their whole target
+  std::string quadVert = shaderDir + (this->temporal ? "/cell_quad.vert"
+                                                     : "/fullscreen_quad.vert");
+  this->edgePass.init(quadVert, shaderDir + "/edge_detect.frag", defines);
+  // Uploaded frames are top-down; flipping here keeps every render target
+  // in GL's bottom-up orientation. Chroma planes for YUV input go on units 1
+  // and 2
+  this->edgePass.shader->setFixedUniform("u_flipY", 1);
+  this->edgePass.shader->setFixedUniform("u_texture", 0);
+  this->edgePass.shader->setFixedUniform("u_chromaTexture", 1);
+  this->edgePass.shader->setFixedUniform("u_chromaTexture2", 2);
+  this->edgePass.shader->setFixedUniform("u_dirty", 3);
+  this->edgePass.shader->bindBlock("EdgeParams", EdgeParamsBinding);
+  this->edgeParams.init(EdgeParamsBinding);
+  this->edgeParams.set(&EdgeParams::threshold, 0.2f);
+  this->histPass.init(shaderDir, allowCompute, this->temporal,
+                      this->layers > 1);
+  this->asciiPass.init(quadVert, shaderDir + "/ascii_render.frag", defines);
+  this->compositePass.init(shaderDir + "/fullscreen_quad.vert",
+                           shaderDir + "/display.frag", defines);
+  this->compositePass.shader->setFixedUniform("u_flipY", 1);
+  this->gridPass.init(quadVert, shaderDir + "/grid_pack.frag", defines);
+  this->gridPass.shader->setFixedUniform("u_texture", 0);
+  this->gridPass.shader->setFixedUniform("u_chromaTexture", 1);
+  this->gridPass.shader->setFixedUniform("u_chromaTexture2", 2);
+  this->gridPass.shader->setFixedUniform("u_cells", 3);
+  this->gridPass.shader->setFixedUniform("u_dirty", 4);
+  this->gridPass.shader->bindBlock("GridParams", GridParamsBinding);
+  this->gridParams.init(GridParamsBinding);
+  // The ascii pass writes top-down like the composite
+  this->asciiPass.shader->setFixedUniform("u_flipY", 1);
+  this->asciiPass.shader->setFixedUniform("u_gridTexture", 0);
+  this->asciiPass.shader->setFixedUniform("u_characterTexture", 1);
+  this->asciiPass.shader->setFixedUniform("u_dirty", 2);
+  this->asciiPass.shader->setFixedUniform("u_topDown", 1);
+  this->asciiPass.shader->bindBlock("AsciiParams", AsciiParamsBinding);
+  this->asciiParams.init(AsciiParamsBinding);
+  prepareAtlas();
+
+  // Edge directions and cells are one quantized channel each; only images
+  // meant for viewing need colour
+  int layers = this->layers;
+  this->source = this->graph.importTexture("source", 0, w, h, layers);
+  this->edges = this->graph.createTexture("edges", edgeWidth(), edgeHeight(),
+                                          TextureFormat::R8, layers);
+  this->cells =
+      this->graph.createTexture("cells", this->gridCols, this->gridRows,
+                                TextureFormat::R8, layers);
+  this->ascii =
+      this->graph.createTexture("ascii", w, h, TextureFormat::RGBA8, layers);
+  this->composite = this->graph.createTexture("composite", w, h,
+                                              TextureFormat::RGBA8, layers);
+  this->grid = this->graph.createTexture(
+      "grid", this->gridCols, this->gridRows,
+      output == PipelineOutput::Grid ? TextureFormat::R8 : TextureFormat::RGBA8,
+      layers);
+
+  // In temporal mode the incremental passes also read the dirty mask
+  auto inputs = [this](std::vector<ResourceId> ids) {
+    if (this->temporal)
+      ids.push_back(this->dirty);
+    return ids;
+  };
+  if (this->temporal)
+    initTemporal(shaderDir);
+
+  this->graph.addPass("edges", inputs({this->source}), {this->edges}, [this] {
+    const FrameUploader &input = *this->input;
+    RenderTarget target = this->graph.target(this->edges);
+    this->edgePass.setTarget(target);
+    // Downsampled targets cover whole cells, which start at the bottom of
+    // the image: the last rows of the top-down input
+    GLVec2 scale = {1.0f, 1.0f};
+    if (edgeFactor() > 1) {
+      GLVec2 cell = cellSize();
+      scale = GLVec2{this->gridCols * cell.x / this->width,
+                     this->gridRows * cell.y / this->height};
+    }
+    this->edgeParams.set(&EdgeParams::sourceScale, scale);
+    this->edgeParams.set(&EdgeParams::sourceOffset,
+                         GLVec2{0.0f, 1.0f - scale.y});
+    this->edgeParams.set(&EdgeParams::textureSize,
+                         GLVec2{target.width / scale.x,
+                                target.height / scale.y});
+    this->edgeParams.set(&EdgeParams::inputFormat, (int)input.format);
+    this->edgePass.instanceCount = cellInstances();
+    this->edgePass.run(input.textures[0], this->quadVAO, [&](GLuint) {
+      this->edgeParams.bind();
+      for (int i = 1; i < input.planeCount; i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(textureTarget(), input.textures[i]);
+      }
+      glActiveTexture(GL_TEXTURE3);
+      glBindTexture(GL_TEXTURE_2D, dirtyMask());
+      glActiveTexture(GL_TEXTURE0);
+    });
+  });
+
+  this->graph.addPass(
+      "histogram", inputs({this->edges}), {this->cells}, [this] {
+        // 10 edge pixels per cell at full resolution. Edges are lines, so
+        // a downsampled cell sees them shrink with its side, not its area
+        // Inputs narrower than the grid have cells under a pixel: count
+        // them as one
+        GLVec2 cell = cellSize();
+        int edgeCell = std::max(1, edgeWidth() / this->gridCols) *
+                       std::max(1, edgeHeight() / this->gridRows);
+        int threshold = std::max(
+            1, (int)std::lround(10.0 * std::sqrt(edgeCell /
+                                                 (cell.x * cell.y))));
+        this->histPass.run(this->graph.texture(this->edges), this->quadVAO,
+                           threshold, this->graph.target(this->cells),
+                           dirtyMask());
+      });
+
+  this->graph.addPass("composite", {this->cells}, {this->composite}, [this] {
+    this->compositePass.setTarget(this->graph.target(this->composite));
+    this->compositePass.run(this->graph.texture(this->cells), this->quadVAO);
+  });
+
+  this->graph.addPass(
+      "grid", inputs({this->source, this->cells}), {this->grid}, [this] {
+        const FrameUploader &input = *this->input;
+        this->gridPass.setTarget(this->graph.target(this->grid));
+        this->gridParams.set(&GridParams::textureSize,
+                             GLVec2{(float)this->width, (float)this->height});
+        this->gridParams.set(&GridParams::cellSize, cellSize());
+        this->gridPass.instanceCount = cellInstances();
+        this->gridParams.set(&GridParams::inputFormat, (int)input.format);
+        this->gridPass.run(input.textures[0], this->quadVAO, [&](GLuint) {
+          this->gridParams.bind();
+          for (int i = 1; i < input.planeCount; i++) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(textureTarget(), input.textures[i]);
+          }
+          glActiveTexture(GL_TEXTURE3);
+          glBindTexture(textureTarget(), this->graph.texture(this->cells));
+          glActiveTexture(GL_TEXTURE4);
+          glBindTexture(GL_TEXTURE_2D, dirtyMask());
+          glActiveTexture(GL_TEXTURE0);
+        });
+      });
+
+  // Expands the packed grid back to full size, one atlas glyph per cell
+  this->graph.addPass("ascii", inputs({this->grid}), {this->ascii}, [this] {
+    this->asciiPass.setTarget(this->graph.target(this->ascii));
+    this->asciiPass.instanceCount = cellInstances();
+    this->asciiParams.set(&AsciiParams::outputSize,
+                          GLVec2{(float)this->width, (float)this->height});
+    this->asciiParams.set(
+        &AsciiParams::cellSize,
+        GLVec2{(float)this->atlas.cellWidth, (float)this->atlas.cellHeight});
+    this->asciiParams.set(
+        &AsciiParams::gridCellDimensions,
+        GLVec2{(float)this->gridCols, (float)this->gridRows});
+    this->asciiPass.run(this->graph.texture(this->grid), this->quadVAO,
+                        [this](GLuint) {
+                          this->asciiParams.bind();
+                          glActiveTexture(GL_TEXTURE1);
+                          glBindTexture(GL_TEXTURE_2D, this->atlas.texture);
+                          glActiveTexture(GL_TEXTURE2);
+                          glBindTexture(GL_TEXTURE_2D, dirtyMask());
+                          glActiveTexture(GL_TEXTURE0);
+                        });
+  });
+
+  switch (output) {
+  case PipelineOutput::Cells:
+    this->outputId = this->cells;
+    break;
+  case PipelineOutput::Grid:
+  case PipelineOutput::ColorGrid:
+    this->outputId = this->grid;
+    break;
+  case PipelineOutput::Ascii:
+    this->outputId = this->ascii;
+    break;
+  default:
+    this->outputId = this->composite;
+  }
+  this->graph.markOutput(this->outputId);
+  this->graph.compile();
+}
+
+void Pipeline::initTemporal(const std::string &shaderDir) {
+  this->signaturePass.init(shaderDir + "/fullscreen_quad.vert",
+                           shaderDir + "/change_signature.frag");
+  this->signaturePass.shader->setFixedUniform("u_texture", 0);
+  this->signaturePass.shader->setFixedUniform("u_chromaTexture", 1);
+  this->signaturePass.shader->setFixedUniform("u_chromaTexture2", 2);
+  this->signaturePass.shader->bindBlock("ChangeParams", ChangeParamsBinding);
+  this->changePass.init(shaderDir + "/fullscreen_quad.vert",
+                        shaderDir + "/change_detect.frag");
+  this->changePass.shader->setFixedUniform("u_signature", 0);
+  this->changePass.shader->setFixedUniform("u_previousSignature", 1);
+  this->changePass.shader->bindBlock("ChangeParams", ChangeParamsBinding);
+  this->changeParams.init(ChangeParamsBinding);
+  this->changeParams.set(&ChangeParams::tolerance, this->changeTolerance);
+
+  // 4x4 block means per cell, and a mask of cells to recompute
+  this->signature =
+      this->graph.createTexture("signature", this->gridCols * 4,
+                                this->gridRows * 4, TextureFormat::RGBA8);
+  this->previousSignature = this->graph.createTexture(
+      "previous signature", this->gridCols * 4, this->gridRows * 4,
+      TextureFormat::RGBA8);
+  this->dirty = this->graph.createTexture("dirty", this->gridCols,
+                                          this->gridRows, TextureFormat::R8);
+  this->graph.markPersistent(this->previousSignature);
+  // Incremental passes leave clean cells alone: their targets must survive
+  // from one frame to the next
+  for (ResourceId id : {this->edges, this->cells, this->grid, this->ascii})
+    this->graph.markPersistent(id);
+  for (RenderPass *pass : {&this->edgePass, &this->gridPass, &this->asciiPass})
+    pass->clearTarget = false;
+
+  this->graph.addPass("signature", {this->source}, {this->signature}, [this] {
+    const FrameUploader &input = *this->input;
+    this->signaturePass.setTarget(this->graph.target(this->signature));
+    this->changeParams.set(&ChangeParams::textureSize,
+                           GLVec2{(float)this->width, (float)this->height});
+    this->changeParams.set(&ChangeParams::cellSize, cellSize());
+    this->changeParams.set(&ChangeParams::inputFormat, (int)input.format);
+    this->signaturePass.run(input.textures[0], this->quadVAO, [&](GLuint) {
+      this->changeParams.bind();
+      for (int i = 1; i < input.planeCount; i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(textureTarget(), input.textures[i]);
+      }
+      glActiveTexture(GL_TEXTURE0);
+    });
+  });
+
+  // Compares, then keeps this frame's signature for the next one
+  this->graph.addPass(
+      "change", {this->signature, this->previousSignature},
+      {this->dirty, this->previousSignature}, [this] {
+        RenderTarget current = this->graph.target(this->signature);
+        RenderTarget previous = this->graph.target(this->previousSignature);
+        this->changePass.setTarget(this->graph.target(this->dirty));
+        this->changeParams.set(&ChangeParams::reset,
+                               this->resetHistory ? 1 : 0);
+        this->changePass.run(current.texture, this->quadVAO, [&](GLuint) {
+          this->changeParams.bind();
+          glActiveTexture(GL_TEXTURE1);
+          glBindTexture(GL_TEXTURE_2D, previous.texture);
+          glActiveTexture(GL_TEXTURE0);
+        });
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, current.fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previous.fbo);
+        glBlitFramebuffer(0, 0, current.width, current.height, 0, 0,
+                          previous.width, previous.height,
+                          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+      });
+}
+
+GLuint Pipeline::dirtyMask() const {
+  return this->temporal ? this->graph.texture(this->dirty) : 0;
+}
+
+GLenum Pipeline::textureTarget() const {
+  return this->layers > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+}
+
+int Pipeline::cellInstances() const {
+  return this->temporal ? this->gridCols * this->gridRows : 1;
+}
+
+GLVec2 Pipeline::cellSize() const {
+  return GLVec2{(float)std::max(1, this->width / this->gridCols),
+                (float)std::max(1, this->height / this->gridRows)};
+}
+
+int Pipeline::edgeFactor() const {
+  return std::clamp(this->edgeDownsample, 1,
+                    maxEdgeDownsample(this->width, this->height,
+                                      this->gridCols));
+}
+
+int Pipeline::edgeWidth() const {
+  int factor = edgeFactor();
+  if (factor == 1)
+    return this->width;
+  return this->gridCols * (this->width / this->gridCols / factor);
+}
+
+int Pipeline::edgeHeight() const {
+  int factor = edgeFactor();
+  if (factor == 1)
+    return this->height;
+  return this->gridRows * (this->height / this->gridRows / factor);
+}
+
+void Pipeline::resize(int w, int h, int cols) {
+  this->width = w;
+  this->height = h;
+  this->gridCols = cols;
+  // Very wide inputs round to no rows at all
+  this->gridRows = std::max(1, gridRowsFor(w, h, cols));
+  this->graph.resize(this->source, w, h);
+  this->graph.resize(this->edges, edgeWidth(), edgeHeight());
+  this->graph.resize(this->cells, this->gridCols, this->gridRows);
+  this->graph.resize(this->ascii, w, h);
+  this->graph.resize(this->composite, w, h);
+  this->graph.resize(this->grid, this->gridCols, this->gridRows);
+  if (this->temporal) {
+    this->graph.resize(this->signature, this->gridCols * 4,
+                       this->gridRows * 4);
+    this->graph.resize(this->previousSignature, this->gridCols * 4,
+                       this->gridRows * 4);
+    this->graph.resize(this->dirty, this->gridCols, this->gridRows);
+  }
+  prepareAtlas();
+  this->graph.compile();
+  this->resetHistory = true;
+}
+
+void Pipeline::setQuality(int downsample, int cols) {
+  int previous = edgeFactor();
+  this->edgeDownsample = downsample;
+  if (cols != this->gridCols || edgeFactor() != previous)
+    resize(this->width, this->height, cols);
+}
+
+void Pipeline::prepareAtlas() {
+  // Only glyph outputs need one
+  if (this->outputKind == PipelineOutput::Cells ||
+      this->outputKind == PipelineOutput::Composite)
+    return;
+  int cellW = std::max(1, this->width / this->gridCols);
+  int cellH = std::max(1, this->height / this->gridRows);
+  bool rebuilt = this->atlas.texture == 0 ||
+                 this->atlas.cellWidth != cellW ||
+                 this->atlas.cellHeight != cellH;
+  if (!this->atlas.prepare(this->glyphStyle, cellW, cellH)) {
+    std::cerr << "No glyph atlas, grid output will be empty" << std::endl;
+    return;
+  }
+  if (rebuilt) {
+    this->atlas.upload();
+    std::cout << "Glyph atlas " << cellW << "x" << cellH << " ("
+              << this->atlas.glyphs.size() << " glyphs, "
+              << (this->atlas.fromCache ? "cached" : "rasterized") << ")"
+              << std::endl;
+  }
+  this->gridParams.set(&GridParams::brightnessLevels,
+                       this->atlas.brightnessLevels);
+  this->asciiParams.set(&AsciiParams::charsetCols, (float)this->atlas.cols);
+  this->asciiParams.set(&AsciiParams::charsetRows, (float)this->atlas.rows);
+}
+
+GLenum Pipeline::readbackFormat() const {
+  switch (this->outputKind) {
+  case PipelineOutput::Grid:
+    return GL_RED;
+  case PipelineOutput::ColorGrid:
+    return GL_RGBA;
+
+  default:
+    return GL_BGR;
+  }
+}
+
+void Pipeline::run(const FrameUploader &input) {
+  this->input = &input;
+  this->graph.setImportedTexture(this->source, input.textures[0]);
+  this->graph.execute();
+  this->input = nullptr;
+  this->resetHistory = false;
+}
+
+Pipeline::~Pipeline() {
+  glDeleteVertexArrays(1, &this->quadVAO);
+  glDeleteBuffers(1, &this->quadVBO);
+}
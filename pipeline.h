@@ -0,0 +1,142 @@
+#pragma once
+#include "frame_upload.h"
+#include "glyph_atlas.h"
+#include "histogram_pass.h"
+#include "param_block.h"
+#include "render_graph.h"
+#include "render_pass.h"
+#include <string>
+
+GLuint createFullscreenQuadVAO(GLuint *vboOut = nullptr);
+// Grid rows that keep cells roughly square for a w x h image
+int gridRowsFor(int w, int h, int cols);
+// Largest edge detection downsample that still leaves every cell at least
+// 4x4 edge pixels to vote on a direction
+int maxEdgeDownsample(int w, int h, int cols);
+
+// Mirrors the EdgeParams block in edge_detect.frag
+struct EdgeParams {
+  GLVec2 textureSize;
+  float threshold;
+  int inputFormat; // PixelFormat
+  GLVec2 sourceOffset;
+  GLVec2 sourceScale;
+};
+
+// Mirrors the GridParams block in grid_pack.frag
+struct GridParams {
+  GLVec2 textureSize;
+  GLVec2 cellSize;
+  int inputFormat; // PixelFormat
+  int brightnessLevels;
+  int padding[2];
+};
+
+// Mirrors the AsciiParams block in ascii_render.frag
+struct AsciiParams {
+  GLVec2 outputSize;
+  GLVec2 cellSize;
+  GLVec2 gridCellDimensions;
+  float charsetCols;
+  float charsetRows;
+};
+
+// Mirrors the ChangeParams block in change_signature.frag and
+// change_detect.frag
+struct ChangeParams {
+  GLVec2 textureSize;
+  GLVec2 cellSize;
+  int inputFormat; // PixelFormat
+  float tolerance;
+  int reset;
+  int padding;
+};
+
+// What the caller reads from the pipeline. Passes that only feed other
+// outputs are culled by the render graph
+enum class PipelineOutput {
+  Cells,     // gridCols x gridRows dominant edge directions (window display)
+  Composite, // Full-size, top-down RGBA8 image for readback
+  Grid,      // gridCols x gridRows R8 glyph indices (see grid_output.h)
+  ColorGrid, // Same, RGBA8 with the mean cell colour in GBA
+  Ascii,     // Full-size, top-down RGBA8 image of coloured glyphs
+};
+
+// The edge -> histogram -> ASCII chain shared by the interactive window and
+// the headless batch mode, expressed as a render graph
+struct Pipeline {
+  GLuint quadVAO = 0, quadVBO = 0;
+  int width = 0, height = 0;
+  int gridCols = 0, gridRows = 0;
+  // Edge detection runs on 1/edgeDownsample of each cell's pixels per axis,
+  // sampled with bilinear taps. Above 1 the edge target only covers whole
+  // cells. Change with setQuality
+  int edgeDownsample = 1;
+  RenderPass edgePass, asciiPass;
+  ParamBlock<EdgeParams> edgeParams;
+  HistogramPass histPass;
+  // Scales the final result back up to the render size, so it can be read
+  // back or written to disk exactly as the window would show it. Rows are
+  // written top-down, so readbacks need no flip
+  RenderPass compositePass;
+  // Packs glyph index and colour per cell, for text output that never
+  // touches full-size pixels
+  RenderPass gridPass;
+  ParamBlock<GridParams> gridParams;
+  // Glyph indices refer to this atlas. Rebuilt (or fetched from its cache)
+  // whenever the cell size changes. Set glyphStyle before init
+  GlyphStyle glyphStyle;
+  GlyphAtlas atlas;
+  ParamBlock<AsciiParams> asciiParams;
+  // Temporal mode, for mostly static footage: a block signature of each
+  // frame is compared with the last one, and the edge, histogram, grid and
+  // ASCII passes only redraw cells that changed by more than
+  // changeTolerance (8-bit levels). Everything else keeps last frame's
+  // result. Set before init
+  bool temporal = false;
+  float changeTolerance = 2.0f;
+  // Batch mode: every target is a texture array, and each pass covers all
+  // layers in one draw or dispatch, so one run() renders a whole batch of
+  // same-sized inputs (FrameUploader with as many layers). Output layer i
+  // belongs to input layer i. Set before init; excludes temporal mode
+  int layers = 1;
+  RenderPass signaturePass, changePass;
+  ParamBlock<ChangeParams> changeParams;
+
+  RenderGraph graph;
+  ResourceId source, edges, cells, ascii, composite, grid;
+  ResourceId signature = -1, previousSignature = -1, dirty = -1;
+
+  // allowCompute: use compute shaders where the context supports them
+  void init(int w, int h, int cols, const std::string &shaderDir,
+            bool allowCompute, PipelineOutput output);
+  // Only render targets whose size changes are reallocated
+  void resize(int w, int h, int cols);
+  // Speed/detail trade-off at the current render size: downsample is clamped
+  // to maxEdgeDownsample. Cheap when nothing changes
+  void setQuality(int downsample, int cols);
+  void run(const FrameUploader &input);
+  RenderTarget output() const { return this->graph.target(this->outputId); }
+  // Format to read output() back with: GL_BGR, GL_RED or GL_RGBA
+  GLenum readbackFormat() const;
+  ~Pipeline();
+
+private:
+  void prepareAtlas();
+  void initTemporal(const std::string &shaderDir);
+  GLuint dirtyMask() const; // 0 outside temporal mode
+  // What the pass textures bind as: GL_TEXTURE_2D_ARRAY in batch mode
+  GLenum textureTarget() const;
+  int cellInstances() const; // Quads per incremental pass
+  // Whole pixels per cell, the way the histogram pass divides them
+  GLVec2 cellSize() const;
+  // edgeDownsample within maxEdgeDownsample, and the edge target it gives
+  int edgeFactor() const;
+  int edgeWidth() const;
+  int edgeHeight() const;
+
+  const FrameUploader *input = nullptr; // Frame being rendered by run()
+  ResourceId outputId = -1;
+  PipelineOutput outputKind = PipelineOutput::Composite;
+  bool resetHistory = true; // Persistent targets hold nothing usable yet
+};
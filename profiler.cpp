@@ -0,0 +1,206 @@
+#include "profiler.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+Profiler *Profiler::active = nullptr;
+
+// Samples kept per stage for the rolling percentiles
+static const size_t kWindow = 1024;
+
+Profiler::~Profiler() {
+  for (const PendingQuery &p : this->pendingQueries)
+    glDeleteQueries(1, &p.query);
+  if (!this->freeQueries.empty())
+    glDeleteQueries((GLsizei)this->freeQueries.size(),
+                    this->freeQueries.data());
+}
+
+int Profiler::stageIndex(const std::string &name, bool gpu) {
+  std::string key = (gpu ? "gpu:" : "cpu:") + name;
+  auto it = this->stageIds.find(key);
+  if (it != this->stageIds.end())
+    return it->second;
+  Stage stage;
+  stage.name = name;
+  stage.gpu = gpu;
+  stage.samples.reserve(kWindow);
+  this->stages.push_back(std::move(stage));
+  int index = (int)this->stages.size() - 1;
+  this->stageIds[key] = index;
+  return index;
+}
+
+void Profiler::addSample(int index, double ms) {
+  Stage &stage = this->stages[index];
+  if (stage.samples.size() < kWindow)
+    stage.samples.push_back(ms);
+  else
+    stage.samples[stage.next] = ms;
+  stage.next = (stage.next + 1) % kWindow;
+  stage.count++;
+  stage.totalMs += ms;
+}
+
+void Profiler::addCpu(const char *stage, double ms) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  addSample(stageIndex(stage, false), ms);
+}
+
+void Profiler::beginGpu(const std::string &stage) {
+  GLuint query;
+  if (this->freeQueries.empty()) {
+    glGenQueries(1, &query);
+  } else {
+    query = this->freeQueries.back();
+    this->freeQueries.pop_back();
+  }
+  int index;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    index = stageIndex(stage, true);
+  }
+  glBeginQuery(GL_TIME_ELAPSED, query);
+  this->pendingQueries.push_back(
+      {query, index, std::chrono::steady_clock::now()});
+}
+
+void Profiler::endGpu() { glEndQuery(GL_TIME_ELAPSED); }
+
+void Profiler::collectQueries(bool wait) {
+  // Queries complete in issue order, so stop at the first unfinished one
+  while (!this->pendingQueries.empty()) {
+    PendingQuery p = this->pendingQueries.front();
+    if (!wait) {
+      GLuint available = GL_FALSE;
+      glGetQueryObjectuiv(p.query, GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available)
+        break;
+    }
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(p.query, GL_QUERY_RESULT, &ns);
+    // A span can't take longer than the wall time since it was issued.
+    // Some timers break that (llvmpipe reports a context's first query as
+    // an absolute timestamp), and such samples are dropped, with a notice
+    double ms = ns * 1e-6;
+    double wallMs = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - p.issued)
+                        .count();
+    if (ms <= wallMs) {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      addSample(p.stage, ms);
+    } else if (!this->badTimerLogged) {
+      this->badTimerLogged = true;
+      std::cerr << "Profiler: GPU timer reported " << ms << " ms for a span "
+                << "issued " << wallMs << " ms ago; dropping such samples"
+                << std::endl;
+    }
+    this->pendingQueries.pop_front();
+    this->freeQueries.push_back(p.query);
+  }
+}
+
+void Profiler::endFrame() {
+  collectQueries(false);
+  if (this->summaryInterval <= 0)
+    return;
+  auto now = std::chrono::steady_clock::now();
+  if (std::chrono::duration<double>(now - this->lastSummary).count() >=
+      this->summaryInterval) {
+    this->lastSummary = now;
+    printSummary("Profile");
+  }
+}
+
+StageReport Profiler::summarize(const Stage &stage) const {
+  StageReport s = {stage.name, stage.gpu, stage.count, 0, 0, 0, 0, 0};
+  if (stage.samples.empty())
+    return s;
+  std::vector<double> sorted = stage.samples;
+  std::sort(sorted.begin(), sorted.end());
+  auto at = [&](double p) {
+    return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+  };
+  s.p50 = at(0.50);
+  s.p95 = at(0.95);
+  s.p99 = at(0.99);
+  s.max = sorted.back();
+  s.mean = stage.totalMs / stage.count;
+  return s;
+}
+
+// One line: "<label>: edges 0.41/0.52/0.60 | ..." with p50/p95/p99 in ms
+void Profiler::printSummary(const char *label) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (this->stages.empty())
+    return;
+  std::cout << label << " (p50/p95/p99 ms):" << std::fixed
+            << std::setprecision(2);
+  for (const Stage &stage : this->stages) {
+    StageReport s = summarize(stage);
+    std::cout << " " << (stage.gpu ? "gpu:" : "") << stage.name << " "
+              << s.p50 << "/" << s.p95 << "/" << s.p99 << " |";
+  }
+  std::cout << std::defaultfloat << std::endl;
+}
+
+std::vector<StageReport> Profiler::report(bool wait) {
+  if (wait)
+    collectQueries(true);
+  std::lock_guard<std::mutex> lock(this->mutex);
+  std::vector<StageReport> reports;
+  for (const Stage &stage : this->stages)
+    reports.push_back(summarize(stage));
+  return reports;
+}
+
+bool Profiler::finish(const std::string &path) {
+  collectQueries(true);
+  printSummary("Profile total");
+  if (path.empty())
+    return true;
+  std::string ext = path.size() >= 4 ? path.substr(path.size() - 4) : "";
+  bool ok = ext == ".csv" ? writeCsv(path) : writeJson(path);
+  if (ok)
+    std::cout << "Wrote profile to " << path << std::endl;
+  return ok;
+}
+
+bool Profiler::writeJson(const std::string &path) {
+  std::ofstream file(path);
+  if (!file) {
+    std::cerr << "Failed to write profile: " << path << std::endl;
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(this->mutex);
+  file << "{\n  \"stages\": [";
+  for (size_t i = 0; i < this->stages.size(); i++) {
+    const Stage &stage = this->stages[i];
+    StageReport s = summarize(stage);
+    file << (i ? "," : "") << "\n    {\"name\": \"" << stage.name
+         << "\", \"kind\": \"" << (stage.gpu ? "gpu" : "cpu")
+         << "\", \"count\": " << stage.count << ", \"mean_ms\": " << s.mean
+         << ", \"p50_ms\": " << s.p50 << ", \"p95_ms\": " << s.p95
+         << ", \"p99_ms\": " << s.p99 << ", \"max_ms\": " << s.max << "}";
+  }
+  file << "\n  ]\n}\n";
+  return (bool)file;
+}
+
+bool Profiler::writeCsv(const std::string &path) {
+  std::ofstream file(path);
+  if (!file) {
+    std::cerr << "Failed to write profile: " << path << std::endl;
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(this->mutex);
+  file << "name,kind,count,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+  for (const Stage &stage : this->stages) {
+    StageReport s = summarize(stage);
+    file << stage.name << "," << (stage.gpu ? "gpu" : "cpu") << ","
+         << stage.count << "," << s.mean << "," << s.p50 << "," << s.p95
+         << "," << s.p99 << "," << s.max << "\n";
+  }
+  return (bool)file;
+}
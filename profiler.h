@@ -0,0 +1,98 @@
+#pragma once
+#include <glad/gl.h>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Rolling statistics of one stage, in milliseconds
+struct StageReport {
+  std::string name;
+  bool gpu;
+  uint64_t count; // Samples ever recorded; percentiles cover the last 1024
+  double mean, p50, p95, p99, max;
+};
+
+// Rolling timings per pipeline stage. GPU passes are measured with
+// GL_TIME_ELAPSED queries whose results are collected frames later, once
+// available, so profiling never stalls the pipeline. CPU work (decode,
+// upload, readback, encode, swap) is measured with steady_clock spans and
+// may be recorded from any thread.
+struct Profiler {
+  // Set while profiling is on; owned by main. Instrumented code checks this
+  // and does nothing when it is null
+  static Profiler *active;
+
+  // Seconds between one-line console summaries; 0 disables them
+  double summaryInterval = 2.0;
+
+  Profiler() = default;
+  Profiler(const Profiler &) = delete;
+  Profiler &operator=(const Profiler &) = delete;
+  ~Profiler();
+
+  void addCpu(const char *stage, double ms);
+  // Render thread only. GPU spans can't nest
+  void beginGpu(const std::string &stage);
+  void endGpu();
+  // Render thread, once per frame: collects finished queries and prints the
+  // periodic summary
+  void endFrame();
+  // Waits for outstanding queries, prints a final summary and, if path is
+  // non-empty, writes a .json or .csv report. Needs the context still alive
+  bool finish(const std::string &path);
+  // Current statistics in first-recorded order. wait collects outstanding
+  // GPU queries first (render thread only)
+  std::vector<StageReport> report(bool wait);
+
+private:
+  struct Stage {
+    std::string name;
+    bool gpu;
+    std::vector<double> samples; // Ring of the latest milliseconds
+    size_t next = 0;
+    uint64_t count = 0;
+    double totalMs = 0.0;
+  };
+  struct PendingQuery {
+    GLuint query;
+    int stage;
+    std::chrono::steady_clock::time_point issued;
+  };
+
+  int stageIndex(const std::string &name, bool gpu); // Caller holds mutex
+  void addSample(int stage, double ms);              // Caller holds mutex
+  void collectQueries(bool wait);
+  StageReport summarize(const Stage &stage) const;
+  void printSummary(const char *label);
+  bool writeJson(const std::string &path);
+  bool writeCsv(const std::string &path);
+
+  std::mutex mutex; // Guards stages
+  std::vector<Stage> stages;
+  std::unordered_map<std::string, int> stageIds;
+
+  std::vector<GLuint> freeQueries;
+  std::deque<PendingQuery> pendingQueries; // In issue order
+  std::chrono::steady_clock::time_point lastSummary =
+      std::chrono::steady_clock::now();
+  bool badTimerLogged = false;
+};
+
+// Records the lifetime of the span as a CPU sample for stage, if profiling
+struct ProfileSpan {
+  explicit ProfileSpan(const char *stage)
+      : stage(stage), start(std::chrono::steady_clock::now()) {}
+  ~ProfileSpan() {
+    if (Profiler::active)
+      Profiler::active->addCpu(
+          this->stage, std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - this->start)
+                           .count());
+  }
+  const char *stage;
+  std::chrono::steady_clock::time_point start;
+};
@@ -0,0 +1,171 @@
+#include "quality_governor.h"
+#include "pipeline.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+int presetDownsample(QualityPreset preset) {
+  switch (preset) {
+  case QualityPreset::High:
+    return 1;
+  case QualityPreset::Balanced:
+    return 2;
+  case QualityPreset::Fast:
+    return 4;
+  }
+  return 1;
+}
+
+bool qualityPresetFromName(const char *name, QualityPreset &preset) {
+  if (std::strcmp(name, "high") == 0)
+    preset = QualityPreset::High;
+  else if (std::strcmp(name, "balanced") == 0)
+    preset = QualityPreset::Balanced;
+  else if (std::strcmp(name, "fast") == 0)
+    preset = QualityPreset::Fast;
+  else
+    return false;
+  return true;
+}
+
+QualityGovernor::~QualityGovernor() {
+  for (const PendingFrame &p : this->pending) {
+    glDeleteQueries(1, &p.begin);
+    glDeleteQueries(1, &p.end);
+  }
+  if (!this->freeQueries.empty())
+    glDeleteQueries((GLsizei)this->freeQueries.size(),
+                    this->freeQueries.data());
+}
+
+void QualityGovernor::init(int w, int h, int minCols, int maxCols,
+                           QualityPreset preset) {
+  this->levels.clear();
+  minCols = std::clamp(minCols, 1, maxCols);
+  int step = std::max(1, maxCols / 8);
+  for (int cols = maxCols;; cols = std::max(minCols, cols - step)) {
+    // Powers of two keep cells an exact number of edge pixels more often
+    int top = 1;
+    while (top * 2 <= maxEdgeDownsample(w, h, cols))
+      top *= 2;
+    if (cols == maxCols) {
+      for (int factor = 1; factor <= top; factor *= 2)
+        this->levels.push_back({factor, cols});
+    } else {
+      this->levels.push_back({top, cols});
+    }
+    if (cols == minCols)
+      break;
+  }
+
+  this->level = 0;
+  int downsample = presetDownsample(preset);
+  while (this->level + 1 < this->levels.size() &&
+         this->levels[this->level + 1].gridCols == maxCols &&
+         this->levels[this->level + 1].edgeDownsample <= downsample)
+    this->level++;
+  this->generation++;
+  this->sumMs = 0.0;
+  this->samples = 0;
+  this->calmWindows = 0;
+  this->calmNeeded = 2;
+  this->justUpgraded = false;
+  if (this->targetMs > 0.0 || this->level > 0)
+    log("start", 0.0);
+}
+
+void QualityGovernor::beginFrame() {
+  if (this->targetMs <= 0.0)
+    return;
+  if (this->freeQueries.size() < 2) {
+    GLuint queries[2];
+    glGenQueries(2, queries);
+    this->freeQueries.insert(this->freeQueries.end(), queries, queries + 2);
+  }
+  this->begin = this->freeQueries.back();
+  this->freeQueries.pop_back();
+  glQueryCounter(this->begin, GL_TIMESTAMP);
+}
+
+void QualityGovernor::endFrame() {
+  if (this->targetMs <= 0.0 || !this->begin)
+    return;
+  GLuint end = this->freeQueries.back();
+  this->freeQueries.pop_back();
+  glQueryCounter(end, GL_TIMESTAMP);
+  this->pending.push_back({this->begin, end, this->generation});
+  this->begin = 0;
+}
+
+bool QualityGovernor::update(QualityLevel &out) {
+  if (this->targetMs <= 0.0)
+    return false;
+  // Timestamps land in issue order, so stop at the first unfinished frame
+  while (!this->pending.empty()) {
+    PendingFrame p = this->pending.front();
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(p.end, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      break;
+    GLuint64 start = 0, finish = 0;
+    glGetQueryObjectui64v(p.begin, GL_QUERY_RESULT, &start);
+    glGetQueryObjectui64v(p.end, GL_QUERY_RESULT, &finish);
+    if (p.generation == this->generation && finish >= start) {
+      this->sumMs += (finish - start) * 1e-6;
+      this->samples++;
+    }
+    this->pending.pop_front();
+    this->freeQueries.push_back(p.begin);
+    this->freeQueries.push_back(p.end);
+  }
+  if (this->samples < this->window)
+    return false;
+
+  double ms = this->sumMs / this->samples;
+  this->sumMs = 0.0;
+  this->samples = 0;
+  const char *reason = nullptr;
+  if (ms > this->targetMs) {
+    // Undoing an upgrade: wait longer before trying it again
+    if (this->justUpgraded)
+      this->calmNeeded = std::min(this->calmNeeded * 2, 32);
+    this->justUpgraded = false;
+    this->calmWindows = 0;
+    if (this->level + 1 < this->levels.size()) {
+      this->level++;
+      reason = "over budget";
+    }
+  } else if (ms < this->targetMs * this->upgradeRatio) {
+    if (this->justUpgraded)
+      this->calmNeeded = 2;
+    this->justUpgraded = false;
+    if (++this->calmWindows >= this->calmNeeded && this->level > 0) {
+      this->level--;
+      this->calmWindows = 0;
+      this->justUpgraded = true;
+      reason = "headroom";
+    }
+  } else {
+    if (this->justUpgraded)
+      this->calmNeeded = 2;
+    this->justUpgraded = false;
+    this->calmWindows = 0;
+  }
+  if (!reason)
+    return false;
+  this->generation++;
+  log(reason, ms);
+  out = current();
+  return true;
+}
+
+void QualityGovernor::log(const char *reason, double ms) const {
+  QualityLevel l = current();
+  std::cout << "Quality: edges at 1/" << l.edgeDownsample << ", "
+            << l.gridCols << " columns (" << reason;
+  if (ms > 0.0)
+    std::cout << ", GPU " << ms << " ms";
+  if (this->targetMs > 0.0)
+    std::cout << ", target " << this->targetMs << " ms";
+  std::cout << ")" << std::endl;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <glad/gl.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Startup speed/detail trade-off: the edge detection downsample to begin
+// with (1, 2 or 4, clamped by cell size)
+enum class QualityPreset { High, Balanced, Fast };
+
+int presetDownsample(QualityPreset preset);
+// "high", "balanced" or "fast"; false if unknown
+bool qualityPresetFromName(const char *name, QualityPreset &preset);
+
+struct QualityLevel {
+  int edgeDownsample;
+  int gridCols;
+};
+
+// Holds a target GPU frame time by trading detail for speed. Each frame's
+// pipeline work is bracketed with GL_TIMESTAMP queries (these can't clash
+// with the profiler's GL_TIME_ELAPSED spans), read back frames later once
+// available. Every window of frames the mean is compared with the budget:
+//
+//   - over it, step down a level: halve the edge detection resolution until
+//     cells are too small to halve again, then drop grid columns an eighth
+//     at a time until minCols
+//   - under upgradeRatio of it, step back up
+//
+// Upgrading needs two calm windows in a row, and an upgrade that had to be
+// undone right away doubles that for the next attempt, so a level whose
+// cost straddles the budget doesn't flip back and forth every second.
+struct QualityGovernor {
+  double targetMs = 0.0; // Frame budget; 0 keeps the starting level
+  double upgradeRatio = 0.6;
+  int window = 30; // Frames per decision
+
+  QualityGovernor() = default;
+  QualityGovernor(const QualityGovernor &) = delete;
+  QualityGovernor &operator=(const QualityGovernor &) = delete;
+  ~QualityGovernor();
+
+  // Builds the ladder of levels for a w x h render, from full detail at
+  // maxCols down to minCols, and starts at the first level with the preset's
+  // downsample. Needs a current context
+  void init(int w, int h, int minCols, int maxCols, QualityPreset preset);
+  QualityLevel current() const { return this->levels[this->level]; }
+  // Bracket the frame's GPU work
+  void beginFrame();
+  void endFrame();
+  // Collects finished queries. Returns true, with the new level in out,
+  // when the caller should switch (Pipeline::setQuality)
+  bool update(QualityLevel &out);
+
+private:
+  struct PendingFrame {
+    GLuint begin, end;
+    uint64_t generation; // Frames timed before a switch are discarded
+  };
+
+  void log(const char *reason, double ms) const;
+
+  std::vector<QualityLevel> levels; // Most detailed first
+  size_t level = 0;
+  uint64_t generation = 0;
+  std::vector<GLuint> freeQueries;
+  std::deque<PendingFrame> pending; // In issue order
+  GLuint begin = 0;                 // Open frame's first query
+
+  double sumMs = 0.0;
+  int samples = 0;
+  int calmWindows = 0;
+  int calmNeeded = 2;
+  bool justUpgraded = false;
+};
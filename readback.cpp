@@ -0,0 +1,108 @@
+#include "readback.h"
+#include "profiler.h"
+#include <cstring>
+#include <iostream>
+
+void ReadbackRing::init(int w, int h, int depth, GLenum format) {
+  this->width = w;
+  this->height = h;
+  this->format = format;
+  this->channels = format == GL_RED ? 1 : format == GL_RGBA ? 4 : 3;
+  this->slots.resize(depth);
+  for (Slot &slot : this->slots) {
+    glGenBuffers(1, &slot.pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    // GL_STREAM_READ: written once by the GPU, read once by us
+    glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)w * h * this->channels,
+                 nullptr, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+bool ReadbackRing::enqueue(GLuint fbo, int tag) {
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+  return readBound(tag);
+}
+
+bool ReadbackRing::enqueueLayer(GLuint texture, int layer, int tag) {
+  if (!this->layerFbo)
+    glGenFramebuffers(1, &this->layerFbo);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, this->layerFbo);
+  glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture,
+                            0, layer);
+  return readBound(tag);
+}
+
+// Reads the bound read framebuffer into the next slot
+bool ReadbackRing::readBound(int tag) {
+  if (full()) {
+    std::cerr << "Readback ring full, dropping frame " << tag << std::endl;
+    return false;
+  }
+  Slot &slot = this->slots[this->head];
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1); // Rows are tightly packed
+  // With a pack buffer bound the last argument is an offset, not a pointer
+  glReadPixels(0, 0, this->width, this->height, this->format,
+               GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot.tag = tag;
+
+  this->head = (this->head + 1) % this->slots.size();
+  this->pending++;
+  return true;
+}
+
+bool ReadbackRing::dequeue(cv::Mat &out, int &tag, bool wait) {
+  if (this->pending == 0)
+    return false;
+  size_t tail =
+      (this->head + this->slots.size() - this->pending) % this->slots.size();
+  Slot &slot = this->slots[tail];
+
+  // Flush on the blocking path, otherwise the fence may never be submitted
+  GLenum status =
+      wait ? glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                              GL_TIMEOUT_IGNORED)
+           : glClientWaitSync(slot.fence, 0, 0);
+  if (status == GL_TIMEOUT_EXPIRED)
+    return false;
+  glDeleteSync(slot.fence);
+  slot.fence = nullptr;
+  tag = slot.tag;
+  this->pending--;
+  if (status == GL_WAIT_FAILED) {
+    std::cerr << "Readback wait failed, dropping frame " << tag << std::endl;
+    out = cv::Mat();
+    return true;
+  }
+
+  // Only the copy out: time spent waiting above is the GPU still rendering
+  ProfileSpan span("readback");
+  out.create(this->height, this->width, CV_8UC(this->channels));
+  size_t bytes = (size_t)this->width * this->channels * this->height;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+  auto *src = static_cast<const uint8_t *>(
+      glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT));
+  if (src) {
+    std::memcpy(out.data, src, bytes);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  } else {
+    std::cerr << "Readback map failed, dropping frame " << tag << std::endl;
+    out = cv::Mat();
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  return true;
+}
+
+ReadbackRing::~ReadbackRing() {
+  for (Slot &slot : this->slots) {
+    if (slot.fence)
+      glDeleteSync(slot.fence);
+    glDeleteBuffers(1, &slot.pbo);
+  }
+  if (this->layerFbo)
+    glDeleteFramebuffers(1, &this->layerFbo);
+}
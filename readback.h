@@ -0,0 +1,42 @@
+#pragma once
+#include <glad/gl.h>
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+// Asynchronous framebuffer readback through a ring of pixel-pack buffers.
+// glReadPixels into a bound PBO returns immediately; a fence tells us when the
+// copy has landed so mapping the buffer never stalls the GPU pipeline.
+struct ReadbackRing {
+  struct Slot {
+    GLuint pbo = 0;
+    GLsync fence = nullptr;
+    int tag = 0; // Caller-defined id (frame number, input index...)
+  };
+
+  std::vector<Slot> slots;
+  int width = 0, height = 0;
+  GLenum format = GL_BGR; // GL_BGR, GL_RGBA or GL_RED
+  int channels = 3;
+  size_t head = 0;    // Next slot to write
+  size_t pending = 0; // Slots in flight, oldest at head - pending
+
+  void init(int w, int h, int depth = 3, GLenum format = GL_BGR);
+  bool full() const { return pending == slots.size(); }
+  bool empty() const { return pending == 0; }
+  // Queues a copy of fbo's color attachment 0. Caller must dequeue when
+  // full(); a full ring refuses (false) rather than overwrite a pending slot
+  bool enqueue(GLuint fbo, int tag);
+  // Same for one layer of a texture array (layered targets read as layer 0)
+  bool enqueueLayer(GLuint texture, int layer, int tag);
+  // Copies the oldest finished readback into out (BGR by default), rows in
+  // framebuffer order (Pipeline::compositePass renders top-down). Returns
+  // false if nothing is pending, or nothing is ready yet and wait is false.
+  // A readback that failed (already logged) frees its slot and comes back
+  // as true with an empty out, so the caller can count that frame as lost
+  bool dequeue(cv::Mat &out, int &tag, bool wait);
+  ~ReadbackRing();
+
+private:
+  GLuint layerFbo = 0; // Read framebuffer for enqueueLayer
+  bool readBound(int tag);
+};
@@ -0,0 +1,269 @@
+#include "render_graph.h"
+#include "gl_ext.h"
+#include "profiler.h"
+#include <algorithm>
+#include <climits>
+#include <iostream>
+
+struct FormatInfo {
+  GLenum internalFormat, format, type;
+  int bytesPerPixel;
+  const char *name;
+};
+
+static FormatInfo formatInfo(TextureFormat format) {
+  switch (format) {
+  case TextureFormat::R8:
+    return {GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1, "R8"};
+  case TextureFormat::RG8:
+    return {GL_RG8, GL_RG, GL_UNSIGNED_BYTE, 2, "RG8"};
+  case TextureFormat::RGBA8:
+    return {GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4, "RGBA8"};
+  case TextureFormat::RGB16F:
+    return {GL_RGB16F, GL_RGB, GL_FLOAT, 6, "RGB16F"};
+  }
+  return {GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4, "RGBA8"};
+}
+
+static RenderTarget createTarget(int width, int height, int layers,
+                                 TextureFormat format) {
+  FormatInfo info = formatInfo(format);
+  RenderTarget target;
+  target.width = width;
+  target.height = height;
+  target.layers = layers;
+
+  GLenum type = layers > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+  glGenTextures(1, &target.texture);
+  glBindTexture(type, target.texture);
+  if (layers > 1) {
+    glTexImage3D(type, 0, info.internalFormat, width, height, layers, 0,
+                 info.format, info.type, nullptr);
+  } else if (glCaps.textureStorage) {
+    glTexStorage2D(type, 1, info.internalFormat, width, height);
+  } else {
+    glTexImage2D(type, 0, info.internalFormat, width, height, 0, info.format,
+                 info.type, nullptr);
+  }
+  glTexParameteri(type, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(type, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(type, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(type, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  if (layers > 1)
+    glTexParameteri(type, GL_TEXTURE_MAX_LEVEL, 0);
+  if (format == TextureFormat::R8) {
+    // Single-channel results read back as grey (r, r, r, 1), the same as
+    // they looked when every pass rendered to RGB
+    GLint swizzle[] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+    glTexParameteriv(type, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+  }
+
+  glGenFramebuffers(1, &target.fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+  // glFramebufferTexture attaches every layer; gl_Layer picks one per draw
+  glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target.texture,
+                       0);
+  return target;
+}
+
+ResourceId RenderGraph::createTexture(const std::string &name, int w, int h,
+                                      TextureFormat format, int layers) {
+  Resource r;
+  r.name = name;
+  r.width = w;
+  r.height = h;
+  r.layers = layers;
+  r.format = format;
+  this->resources.push_back(r);
+  return (ResourceId)this->resources.size() - 1;
+}
+
+ResourceId RenderGraph::importTexture(const std::string &name, GLuint texture,
+                                      int w, int h, int layers) {
+  ResourceId id = createTexture(name, w, h, TextureFormat::RGBA8, layers);
+  this->resources[id].imported = true;
+  this->resources[id].importedTexture = texture;
+  return id;
+}
+
+void RenderGraph::setImportedTexture(ResourceId id, GLuint texture) {
+  this->resources[id].importedTexture = texture;
+}
+
+void RenderGraph::resize(ResourceId id, int w, int h) {
+  this->resources[id].width = w;
+  this->resources[id].height = h;
+}
+
+void RenderGraph::addPass(const std::string &name,
+                          std::vector<ResourceId> inputs,
+                          std::vector<ResourceId> outputs,
+                          std::function<void()> execute) {
+  Pass p;
+  p.name = name;
+  p.inputs = std::move(inputs);
+  p.outputs = std::move(outputs);
+  p.execute = std::move(execute);
+  this->passes.push_back(std::move(p));
+}
+
+void RenderGraph::markOutput(ResourceId id) {
+  this->resources[id].output = true;
+}
+
+void RenderGraph::markPersistent(ResourceId id) {
+  this->resources[id].persistent = true;
+}
+
+void RenderGraph::compile() {
+  // Cull: walk backwards from the graph outputs, keeping only passes that
+  // write something a kept pass (or the caller) reads
+  std::vector<bool> needed(this->resources.size(), false);
+  for (size_t i = 0; i < this->resources.size(); i++)
+    needed[i] = this->resources[i].output;
+  for (int p = (int)this->passes.size() - 1; p >= 0; p--) {
+    Pass &pass = this->passes[p];
+    pass.culled = true;
+    for (ResourceId out : pass.outputs) {
+      if (needed[out])
+        pass.culled = false;
+    }
+    if (!pass.culled) {
+      for (ResourceId in : pass.inputs)
+        needed[in] = true;
+    }
+  }
+
+  // Lifetimes: from the producing pass to the last pass reading it
+  std::vector<int> lastUse(this->resources.size(), -1);
+  for (size_t p = 0; p < this->passes.size(); p++) {
+    const Pass &pass = this->passes[p];
+    if (pass.culled)
+      continue;
+    for (ResourceId in : pass.inputs)
+      lastUse[in] = (int)p;
+    for (ResourceId out : pass.outputs)
+      lastUse[out] = std::max(lastUse[out], (int)p);
+  }
+  for (size_t i = 0; i < this->resources.size(); i++) {
+    if (this->resources[i].output || this->resources[i].persistent)
+      lastUse[i] = INT_MAX; // Read after execute() returns
+  }
+
+  // Assign physical textures in pass order. A pooled texture can be reused
+  // once the last reader of its previous resource has run
+  std::vector<bool> usedThisCompile(this->pool.size(), false);
+  for (PhysicalTexture &t : this->pool)
+    t.busyUntil = -1;
+  for (Resource &r : this->resources)
+    r.physical = -1;
+
+  for (size_t p = 0; p < this->passes.size(); p++) {
+    const Pass &pass = this->passes[p];
+    if (pass.culled)
+      continue;
+    for (ResourceId out : pass.outputs) {
+      Resource &r = this->resources[out];
+      if (r.imported || r.physical != -1)
+        continue;
+      for (size_t t = 0; t < this->pool.size(); t++) {
+        const PhysicalTexture &tex = this->pool[t];
+        // Persistent resources only keep a texture nothing else used this
+        // frame, so no other pass overwrites what they carry over
+        if (r.persistent && usedThisCompile[t])
+          continue;
+        if (tex.busyUntil < (int)p && tex.format == r.format &&
+            tex.target.width == r.width && tex.target.height == r.height &&
+            tex.target.layers == r.layers) {
+          r.physical = (int)t;
+          break;
+        }
+      }
+      if (r.physical == -1) {
+        PhysicalTexture tex;
+        tex.target = createTarget(r.width, r.height, r.layers, r.format);
+        tex.format = r.format;
+        this->pool.push_back(tex);
+        usedThisCompile.push_back(false);
+        r.physical = (int)this->pool.size() - 1;
+        std::cout << "Render graph: allocated " << r.width << "x" << r.height;
+        if (r.layers > 1)
+          std::cout << "x" << r.layers;
+        std::cout << " " << formatInfo(r.format).name << " for " << r.name
+                  << std::endl;
+      }
+      this->pool[r.physical].busyUntil = lastUse[out];
+      usedThisCompile[r.physical] = true;
+    }
+  }
+
+  // Free whatever the new layout no longer needs (old sizes after a resize)
+  std::vector<PhysicalTexture> kept;
+  std::vector<int> remap(this->pool.size(), -1);
+  for (size_t t = 0; t < this->pool.size(); t++) {
+    if (usedThisCompile[t]) {
+      remap[t] = (int)kept.size();
+      kept.push_back(this->pool[t]);
+    } else {
+      glDeleteFramebuffers(1, &this->pool[t].target.fbo);
+      glDeleteTextures(1, &this->pool[t].target.texture);
+    }
+  }
+  this->pool = kept;
+  for (Resource &r : this->resources) {
+    if (r.physical != -1)
+      r.physical = remap[r.physical];
+  }
+
+  size_t bytes = 0;
+  for (const PhysicalTexture &t : this->pool) {
+    bytes += (size_t)t.target.width * t.target.height * t.target.layers *
+             formatInfo(t.format).bytesPerPixel;
+  }
+  int culled = 0;
+  for (const Pass &pass : this->passes) {
+    if (pass.culled) {
+      culled++;
+      std::cout << "Render graph: culled unused pass " << pass.name
+                << std::endl;
+    }
+  }
+  std::cout << "Render graph: " << this->passes.size() - culled << " pass(es), "
+            << this->pool.size() << " texture(s), " << bytes / 1024
+            << " KiB" << std::endl;
+}
+
+void RenderGraph::execute() {
+  Profiler *profiler = Profiler::active;
+  for (Pass &pass : this->passes) {
+    if (pass.culled)
+      continue;
+    if (profiler)
+      profiler->beginGpu(pass.name);
+    pass.execute();
+    if (profiler)
+      profiler->endGpu();
+  }
+}
+
+RenderTarget RenderGraph::target(ResourceId id) const {
+  const Resource &r = this->resources[id];
+  if (r.imported) {
+    RenderTarget t;
+    t.texture = r.importedTexture;
+    t.width = r.width;
+    t.height = r.height;
+    t.layers = r.layers;
+    return t;
+  }
+  if (r.physical == -1)
+    return RenderTarget(); // Culled
+  return this->pool[r.physical].target;
+}
+
+RenderGraph::~RenderGraph() {
+  for (PhysicalTexture &t : this->pool) {
+    glDeleteFramebuffers(1, &t.target.fbo);
+    glDeleteTextures(1, &t.target.texture);
+  }
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "render_pass.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+enum class TextureFormat { R8, RG8, RGBA8, RGB16F };
+
+typedef int ResourceId;
+
+// Small render graph on top of RenderPass. Passes declare which textures they
+// read and write; compile() drops passes whose outputs nobody consumes,
+// works out how long each texture lives and backs textures whose lifetimes
+// don't overlap with the same physical allocation. Recompiling after a
+// resize only reallocates textures whose size or format actually changed.
+struct RenderGraph {
+  // layers > 1 makes a texture array (see RenderTarget)
+  ResourceId createTexture(const std::string &name, int w, int h,
+                           TextureFormat format, int layers = 1);
+  // A texture owned elsewhere (e.g. uploaded frames). Never pooled or culled
+  ResourceId importTexture(const std::string &name, GLuint texture, int w,
+                           int h, int layers = 1);
+  void setImportedTexture(ResourceId id, GLuint texture);
+  // Takes effect on the next compile()
+  void resize(ResourceId id, int w, int h);
+
+  void addPass(const std::string &name, std::vector<ResourceId> inputs,
+               std::vector<ResourceId> outputs, std::function<void()> execute);
+  // Results read outside the graph; passes feeding them are never culled
+  void markOutput(ResourceId id);
+  // Contents carry over from one execute() to the next (passes that only
+  // update part of a texture): never shares its allocation. Contents are
+  // undefined again after a compile() that changed its size
+  void markPersistent(ResourceId id);
+
+  void compile();
+  void execute();
+
+  // Valid after compile()
+  RenderTarget target(ResourceId id) const;
+  GLuint texture(ResourceId id) const { return target(id).texture; }
+  ~RenderGraph();
+
+private:
+  struct Resource {
+    std::string name;
+    int width, height, layers;
+    TextureFormat format;
+    bool imported = false;
+    GLuint importedTexture = 0;
+    bool output = false;
+    bool persistent = false;
+    int physical = -1; // Index into pool
+  };
+  struct Pass {
+    std::string name;
+    std::vector<ResourceId> inputs, outputs;
+    std::function<void()> execute;
+    bool culled = false;
+  };
+  struct PhysicalTexture {
+    RenderTarget target;
+    TextureFormat format;
+    int busyUntil; // Last pass index reading it in the current compile
+  };
+
+  std::vector<Resource> resources;
+  std::vector<Pass> passes;
+  std::vector<PhysicalTexture> pool;
+};
@@ -1,19 +1,44 @@
 #pragma once
 #include <string>
 #include "shader_utils.h"
+#include <functional>
 #include <memory>
 
+// Where a pass draws to: an FBO with a single color texture. With more than
+// one layer the texture is a GL_TEXTURE_2D_ARRAY attached whole (layered)
+struct RenderTarget {
+  GLuint fbo = 0, texture = 0;
+  int width = 0, height = 0;
+  int layers = 1;
+};
+
+// ShaderProgram defines for the LAYERED variants of the pass shaders, which
+// read and write texture arrays (one batch input per layer). Needs a context
+std::string layeredDefines();
+
 struct RenderPass {
   std::unique_ptr<ShaderProgram> shader;
-  GLuint fbo, texture;
-  int width, height;
+  GLuint fbo = 0, texture = 0;
+  int width = 0, height = 0;
+  // Layered targets read a texture array on unit 0 too, and draw every layer
+  // (the LAYERED variant of fullscreen_quad.vert picks it per instance)
+  int layers = 1;
+  // Off for passes that only redraw part of a target and keep the rest
+  bool clearTarget = true;
+  // Quads drawn per run() on a single-layer target; vertex shaders tell them
+  // apart by gl_InstanceID
+  int instanceCount = 1;
 
   // We use init instead of constructor because of OpenGL obj ownership
-  // May need to be created before all OpenGL resources are available
-  void init(int w, int h, const std::string &vertPath,
-            const std::string &fragPath);
-  void run(GLuint inputTex, GLuint vao);
+  // May need to be created before all OpenGL resources are available.
+  // Builds the shader only: targets come from a RenderGraph via setTarget.
+  // defines: see ShaderProgram::defines
+  void init(const std::string &vertPath, const std::string &fragPath,
+            const std::string &defines = "");
+  void setTarget(const RenderTarget &target);
   void run(GLuint inputTex, GLuint vao,
-           std::function<void(GLuint)> setUniforms);
-  ~RenderPass(); // Automatically clean up GL resources on destruction
-};
\ No newline at end of file
+           std::function<void(GLuint)> setUniforms = nullptr);
+
+private:
+  int texelSizeHandle = -1, layerHandle = -1;
+};
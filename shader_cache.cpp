@@ -0,0 +1,158 @@
+#include "shader_cache.h"
+#include "gl_ext.h"
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+#include <vector>
+
+// Cache file layout: header followed by the driver's binary blob
+struct CacheHeader {
+  char magic[4]; // "ATSB"
+  uint32_t version;
+  uint32_t binaryFormat;
+  uint32_t length;
+};
+static const uint32_t kCacheVersion = 1;
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed) {
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  uint64_t hash = seed;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+std::string ShaderCache::defaultDirectory() {
+  const char *xdg = std::getenv("XDG_CACHE_HOME");
+  if (xdg && *xdg)
+    return std::string(xdg) + "/atsuki/shaders";
+  const char *home = std::getenv("HOME");
+  if (home && *home)
+    return std::string(home) + "/.cache/atsuki/shaders";
+  return ".atsuki-cache/shaders";
+}
+
+void ShaderCache::init(const std::string &dir) {
+  this->directory = dir;
+  this->enabled = false;
+  if (!glCaps.programBinary) {
+    std::cout << "Shader cache: driver has no program binary formats, "
+                 "disabled"
+              << std::endl;
+    return;
+  }
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  if (ec) {
+    std::cerr << "Shader cache: cannot create " << dir << ": "
+              << ec.message() << std::endl;
+    return;
+  }
+  this->contextId = std::string((const char *)glGetString(GL_VENDOR)) + "|" +
+                    (const char *)glGetString(GL_RENDERER) + "|" +
+                    (const char *)glGetString(GL_VERSION);
+  this->enabled = true;
+}
+
+std::string ShaderCache::key(const std::string *sources, int sourceCount,
+                             const std::string &defines) const {
+  uint64_t hash = hashBytes(this->contextId.data(), this->contextId.size());
+  // Separators keep ("ab", "c") and ("a", "bc") apart
+  const char separator = '\0';
+  hash = hashBytes(defines.data(), defines.size(), hash);
+  for (int i = 0; i < sourceCount; i++) {
+    hash = hashBytes(&separator, 1, hash);
+    hash = hashBytes(sources[i].data(), sources[i].size(), hash);
+  }
+  char hex[17];
+  std::snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+  return hex;
+}
+
+std::string ShaderCache::pathFor(const std::string &key) const {
+  return this->directory + "/" + key + ".bin";
+}
+
+GLuint ShaderCache::load(const std::string &key) {
+  if (!this->enabled)
+    return 0;
+  std::ifstream file(pathFor(key), std::ios::binary);
+  CacheHeader header;
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      std::string(header.magic, 4) != "ATSB" ||
+      header.version != kCacheVersion) {
+    return 0;
+  }
+  // A truncated or padded file (interrupted copy, disk trouble) is a miss,
+  // not an allocation of whatever length the header claims
+  std::error_code ec;
+  uintmax_t size = std::filesystem::file_size(pathFor(key), ec);
+  if (ec || size != sizeof(header) + (uintmax_t)header.length)
+    return 0;
+  std::vector<char> binary(header.length);
+  if (!file.read(binary.data(), binary.size()))
+    return 0;
+
+  GLuint program = glCreateProgram();
+  glProgramBinary(program, header.binaryFormat, binary.data(), header.length);
+  GLint success = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+    // Typically a driver update that kept the same version string
+    glDeleteProgram(program);
+    this->rejected++;
+    return 0;
+  }
+  return program;
+}
+
+void ShaderCache::store(const std::string &key, GLuint program) {
+  if (!this->enabled)
+    return;
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return;
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+  CacheHeader header = {{'A', 'T', 'S', 'B'},
+                        kCacheVersion,
+                        (uint32_t)format,
+                        (uint32_t)length};
+  // Write then rename so a concurrent reader never sees half a file. The
+  // temporary name is per process, as other processes may be storing the
+  // same key
+  std::string path = pathFor(key);
+  std::string tmpPath = path + "." + std::to_string(getpid()) + ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(binary.data(), binary.size());
+    if (!file) {
+      std::cerr << "Shader cache: failed to write " << tmpPath << std::endl;
+      return;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, path, ec);
+  if (ec)
+    std::filesystem::remove(tmpPath, ec);
+}
+
+void ShaderCache::printStats() const {
+  if (!this->enabled)
+    return;
+  std::cout << "Shader cache: " << this->hits << " hit(s), " << this->misses
+            << " miss(es)";
+  if (this->rejected)
+    std::cout << " (" << this->rejected << " rejected by driver)";
+  std::cout << ", programs ready in " << this->buildSeconds * 1000.0 << " ms"
+            << std::endl;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <glad/gl.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 64-bit FNV-1a, chainable through seed. Used to key on-disk caches
+uint64_t hashBytes(const void *data, size_t size,
+                   uint64_t seed = 0xcbf29ce484222325ull);
+
+// On-disk cache of linked program binaries (glGetProgramBinary). Entries
+// are keyed by the shader sources, defines and the GL renderer/version, so a
+// driver update or an edited shader simply misses. A binary the driver
+// refuses to load is treated as a miss and overwritten after the rebuild.
+struct ShaderCache {
+  std::string directory;
+  bool enabled = false;
+  // Startup metrics. load() also runs on the compile worker, so the counts
+  // are atomic
+  std::atomic<int> hits{0}, misses{0}, rejected{0};
+  double buildSeconds = 0.0; // Time spent producing programs either way
+
+  // Needs a current context; disables itself without program binary support
+  void init(const std::string &dir);
+  std::string key(const std::string *sources, int sourceCount,
+                  const std::string &defines) const;
+  // Returns a linked program, or 0 on a miss
+  GLuint load(const std::string &key);
+  void store(const std::string &key, GLuint program);
+  void printStats() const;
+
+  // $XDG_CACHE_HOME/atsuki/shaders, else ~/.cache/atsuki/shaders
+  static std::string defaultDirectory();
+
+private:
+  std::string contextId; // Renderer and version strings
+  std::string pathFor(const std::string &key) const;
+};
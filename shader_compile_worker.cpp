@@ -0,0 +1,58 @@
+#include "shader_compile_worker.h"
+#include <future>
+#include <iostream>
+
+bool ShaderCompileWorker::start(std::function<bool()> bind,
+                                std::function<void()> release) {
+  std::promise<bool> bound;
+  std::future<bool> result = bound.get_future();
+  this->thread = std::thread([this, &bound, bind, release] {
+    bool ok = bind();
+    bound.set_value(ok);
+    if (ok)
+      run(release);
+  });
+  if (!result.get()) {
+    this->thread.join();
+    std::cerr << "Shader compile worker: cannot bind its context"
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void ShaderCompileWorker::submit(std::function<void()> job) {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->jobs.push_back(std::move(job));
+  }
+  this->wake.notify_one();
+}
+
+void ShaderCompileWorker::run(std::function<void()> release) {
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->wake.wait(lock,
+                      [this] { return this->stopping || !this->jobs.empty(); });
+      if (this->jobs.empty())
+        break; // Stopping, and nothing left to run
+      job = std::move(this->jobs.front());
+      this->jobs.pop_front();
+    }
+    job();
+  }
+  release();
+}
+
+ShaderCompileWorker::~ShaderCompileWorker() {
+  if (!this->thread.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stopping = true;
+  }
+  this->wake.notify_one();
+  this->thread.join();
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Runs shader builds on a thread of its own, with a GL context that shares
+// objects with the render context. Hot reloads use it on drivers without
+// KHR_parallel_shader_compile, where compiling and linking on the render
+// thread would stall the frame that starts them. Jobs run one at a time, in
+// the order they were submitted.
+struct ShaderCompileWorker {
+  ShaderCompileWorker() = default;
+  ShaderCompileWorker(const ShaderCompileWorker &) = delete;
+  ShaderCompileWorker &operator=(const ShaderCompileWorker &) = delete;
+  ~ShaderCompileWorker(); // Runs the jobs still queued, then releases
+
+  // bind makes the shared context current on the worker thread and returns
+  // false if it can't; release detaches it before the thread exits. Returns
+  // false (after printing why) if the worker couldn't bind its context
+  bool start(std::function<bool()> bind, std::function<void()> release);
+  void submit(std::function<void()> job);
+
+private:
+  void run(std::function<void()> release);
+
+  std::thread thread;
+  std::mutex mutex; // Guards jobs and stopping
+  std::condition_variable wake;
+  std::deque<std::function<void()>> jobs;
+  bool stopping = false;
+};
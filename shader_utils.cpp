@@ -1,4 +1,8 @@
 #include "shader_utils.h"
+#include "gl_ext.h"
+#include "shader_cache.h"
+#include "shader_compile_worker.h"
+#include "shader_watcher.h"
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -15,77 +19,276 @@ static std::string readFile(const std::string &path) {
   return buffer.str();
 }
 
+ShaderCache *ShaderProgram::cache = nullptr;
+ShaderWatcher *ShaderProgram::watcher = nullptr;
+ShaderCompileWorker *ShaderProgram::compileWorker = nullptr;
+
+// Defines must follow the #version directive, which has to come first
+static std::string injectDefines(const std::string &src,
+                                 const std::string &defines) {
+  if (defines.empty())
+    return src;
+  size_t lineEnd = src.find('\n', src.find("#version"));
+  if (lineEnd == std::string::npos)
+    return defines + src;
+  return src.substr(0, lineEnd + 1) + defines + src.substr(lineEnd + 1);
+}
+
+// Compile status is not queried here: with KHR_parallel_shader_compile that
+// would wait for the compile, which is exactly what reloads avoid
 static GLuint compileShader(GLenum type, const std::string &src) {
   GLuint shader = glCreateShader(type);
   const char *csrc = src.c_str();
   glShaderSource(shader, 1, &csrc, nullptr);
   glCompileShader(shader);
+  return shader;
+}
 
-  // Check for successful compilation
-  GLint success;
-  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-  if (!success) {
-    char log[512];
-    glGetShaderInfoLog(shader, 512, nullptr, log);
-    std::cerr << "Shader compilation error:\n" << log << std::endl;
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+ShaderProgram::Sources ShaderProgram::sources() const {
+  return {this->vertPath, this->fragPath, this->compPath, this->defines};
+}
+
+void ShaderProgram::beginBuild(Build &build, const Sources &in) {
+  build.start = std::chrono::steady_clock::now();
+  GLenum types[2];
+  std::string sources[2];
+  if (!in.compPath.empty()) {
+    types[build.shaderCount] = GL_COMPUTE_SHADER;
+    sources[build.shaderCount++] = readFile(in.compPath);
+  } else {
+    types[build.shaderCount] = GL_VERTEX_SHADER;
+    sources[build.shaderCount++] = readFile(in.vertPath);
+    types[build.shaderCount] = GL_FRAGMENT_SHADER;
+    sources[build.shaderCount++] = readFile(in.fragPath);
   }
-  return shader;
+  for (int i = 0; i < build.shaderCount; i++)
+    sources[i] = injectDefines(sources[i], in.defines);
+
+  if (cache && cache->enabled) {
+    build.cacheKey = cache->key(sources, build.shaderCount, in.defines);
+    build.program = cache->load(build.cacheKey);
+    if (build.program) {
+      build.fromCache = true;
+      build.shaderCount = 0;
+      return;
+    }
+  }
+
+  build.program = glCreateProgram();
+  for (int i = 0; i < build.shaderCount; i++) {
+    build.shaders[i] = compileShader(types[i], sources[i]);
+    glAttachShader(build.program, build.shaders[i]);
+  }
+  // Without the hint some drivers return an empty binary
+  if (!build.cacheKey.empty())
+    glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                        GL_TRUE);
+  glLinkProgram(build.program);
 }
 
-ShaderProgram::ShaderProgram(const std::string &vp, const std::string &fp)
-    : vertPath(vp), fragPath(fp),
-      lastFragTime(std::filesystem::last_write_time(fp)) {
-  std::string vertSrc = readFile(vp);
-  std::string fragSrc = readFile(fp);
+bool ShaderProgram::buildReady(const Build &build) const {
+  if (build.async)
+    return build.done.load();
+  if (build.fromCache || !glCaps.parallelShaderCompile)
+    return true;
+  GLint done = GL_FALSE;
+  glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &done);
+  return done == GL_TRUE;
+}
 
-  GLuint vert = compileShader(GL_VERTEX_SHADER, vertSrc);
-  GLuint frag = compileShader(GL_FRAGMENT_SHADER, fragSrc);
+bool ShaderProgram::finishBuild(Build &build, const char *what) {
+  if (build.fromCache) {
+    cache->hits++;
+    cache->buildSeconds += secondsSince(build.start);
+    return true;
+  }
 
-  this->id = glCreateProgram();
-  glAttachShader(this->id, vert);
-  glAttachShader(this->id, frag);
-  glLinkProgram(this->id);
   GLint success;
-  glGetProgramiv(this->id, GL_LINK_STATUS, &success);
+  glGetProgramiv(build.program, GL_LINK_STATUS, &success);
   if (!success) {
     char log[512];
-    glGetProgramInfoLog(this->id, 512, nullptr, log);
-    std::cerr << "Shader program link error:\n" << log << std::endl;
+    for (int i = 0; i < build.shaderCount; i++) {
+      GLint compiled;
+      glGetShaderiv(build.shaders[i], GL_COMPILE_STATUS, &compiled);
+      if (!compiled) {
+        glGetShaderInfoLog(build.shaders[i], 512, nullptr, log);
+        std::cerr << "Shader compilation error:\n" << log << std::endl;
+      }
+    }
+    glGetProgramInfoLog(build.program, 512, nullptr, log);
+    std::cerr << "Shader program " << what << " error:\n" << log << std::endl;
+  }
+
+  for (int i = 0; i < build.shaderCount; i++)
+    glDeleteShader(build.shaders[i]);
+  build.shaderCount = 0;
+
+  if (!build.cacheKey.empty()) {
+    cache->misses++;
+    if (success)
+      cache->store(build.cacheKey, build.program);
+    cache->buildSeconds += secondsSince(build.start);
   }
+  return success == GL_TRUE;
+}
 
-  glDeleteShader(vert);
-  glDeleteShader(frag);
+ShaderProgram::ShaderProgram(const std::string &vp, const std::string &fp,
+                             const std::string &defines)
+    : vertPath(vp), fragPath(fp), defines(defines) {
+  Build build;
+  beginBuild(build, sources());
+  finishBuild(build, "link");
+  this->id = build.program;
+  if (watcher) {
+    watcher->watch(vp);
+    watcher->watch(fp);
+    this->seenSerial = watcher->serial();
+  }
 }
 
-ShaderProgram::~ShaderProgram() { glDeleteProgram(id); }
+ShaderProgram::ShaderProgram(const std::string &cp)
+    : ShaderProgram(ComputeTag(), cp, "") {}
+
+std::unique_ptr<ShaderProgram>
+ShaderProgram::compute(const std::string &cp, const std::string &defines) {
+  return std::unique_ptr<ShaderProgram>(
+      new ShaderProgram(ComputeTag(), cp, defines));
+}
+
+ShaderProgram::ShaderProgram(ComputeTag, const std::string &cp,
+                             const std::string &defines)
+    : compPath(cp), defines(defines) {
+  Build build;
+  beginBuild(build, sources());
+  finishBuild(build, "link");
+  this->id = build.program;
+  if (watcher) {
+    watcher->watch(cp);
+    this->seenSerial = watcher->serial();
+  }
+}
+
+static void discardBuild(GLuint program, const GLuint *shaders, int count) {
+  for (int i = 0; i < count; i++)
+    glDeleteShader(shaders[i]);
+  glDeleteProgram(program);
+}
+
+ShaderProgram::~ShaderProgram() {
+  if (this->pending && this->pending->async && !this->pending->done) {
+    // Still building: the worker discards it after its job, in order
+    std::shared_ptr<Build> build = this->pending;
+    compileWorker->submit([build] {
+      discardBuild(build->program, build->shaders, build->shaderCount);
+    });
+  } else if (this->pending) {
+    discardBuild(this->pending->program, this->pending->shaders,
+                 this->pending->shaderCount);
+  }
+  glDeleteProgram(id);
+}
 
 void ShaderProgram::reloadIfChanged() {
-  auto newTime = std::filesystem::last_write_time(this->fragPath);
-  if (newTime != lastFragTime) {
-    std::cout << "Reloading shader: " << fragPath << std::endl;
-    glDeleteProgram(id);
-
-    std::string vertSrc = readFile(this->vertPath);
-    std::string fragSrc = readFile(this->fragPath);
-
-    GLuint vert = compileShader(GL_VERTEX_SHADER, vertSrc);
-    GLuint frag = compileShader(GL_FRAGMENT_SHADER, fragSrc);
-
-    this->id = glCreateProgram();
-    glAttachShader(this->id, vert);
-    glAttachShader(this->id, frag);
-    glLinkProgram(this->id);
-    GLint success;
-    glGetProgramiv(this->id, GL_LINK_STATUS, &success);
-    if (!success) {
-      char log[512];
-      glGetProgramInfoLog(this->id, 512, nullptr, log);
-      std::cerr << "Shader program reload link error:\n" << log << std::endl;
+  if (this->pending) {
+    if (!buildReady(*this->pending))
+      return;
+    GLuint program = this->pending->program;
+    const std::string &name = compPath.empty() ? fragPath : compPath;
+    if (finishBuild(*this->pending, "reload link")) {
+      glDeleteProgram(this->id);
+      this->id = program;
+      reflect();
+      std::cout << "Reloaded shader: " << name << std::endl;
+    } else {
+      glDeleteProgram(program);
+      std::cerr << "Keeping previous program for " << name << std::endl;
     }
+    this->pending.reset();
+    // Edits made while compiling are picked up on the next call
+    return;
+  }
+
+  // Common case: one atomic load, no filesystem access
+  if (!watcher || watcher->serial() == this->seenSerial)
+    return;
+  uint64_t since = this->seenSerial;
+  this->seenSerial = watcher->serial();
+  bool changed = false;
+  for (const std::string *path : {&vertPath, &fragPath, &compPath}) {
+    if (!path->empty() && watcher->changedSince(*path, since))
+      changed = true;
+  }
+  if (!changed)
+    return;
 
-    glDeleteShader(vert);
-    glDeleteShader(frag);
+  std::cout << "Reloading shader: " << (compPath.empty() ? fragPath : compPath)
+            << std::endl;
+  this->pending = std::make_shared<Build>();
+  if (glCaps.parallelShaderCompile) {
+    beginBuild(*this->pending, sources());
+  } else if (compileWorker) {
+    std::shared_ptr<Build> build = this->pending;
+    build->async = true;
+    compileWorker->submit([build, in = sources()] {
+      beginBuild(*build, in);
+      // Another context may only use the program once its link is complete
+      glFinish();
+      build->done = true;
+    });
+  } else {
+    std::cerr << "No parallel shader compile or compile worker, reload "
+                 "blocks the render thread"
+              << std::endl;
+    beginBuild(*this->pending, sources());
+  }
+}
+
+int ShaderProgram::uniformHandle(const char *name) {
+  for (size_t i = 0; i < this->uniformNames.size(); i++) {
+    if (this->uniformNames[i] == name)
+      return (int)i;
+  }
+  this->uniformNames.push_back(name);
+  this->uniformLocations.push_back(glGetUniformLocation(this->id, name));
+  return (int)this->uniformNames.size() - 1;
+}
+
+void ShaderProgram::setFixedUniform(const char *name, int value) {
+  this->fixedUniforms.emplace_back(name, value);
+  reflect();
+}
+
+void ShaderProgram::bindBlock(const char *name, GLuint binding) {
+  this->blockBindings.emplace_back(name, binding);
+  reflect();
+}
+
+void ShaderProgram::reflect() {
+  for (size_t i = 0; i < this->uniformNames.size(); i++)
+    this->uniformLocations[i] =
+        glGetUniformLocation(this->id, this->uniformNames[i].c_str());
+
+  // Uniform values are program state, so they survive until the next link.
+  // GL 3.3 has no glProgramUniform, so bind the program briefly
+  GLint previous = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+  glUseProgram(this->id);
+  for (const auto &fixed : this->fixedUniforms) {
+    GLint location = glGetUniformLocation(this->id, fixed.first.c_str());
+    if (location != -1)
+      glUniform1i(location, fixed.second);
+  }
+  glUseProgram(previous);
 
-    lastFragTime = newTime;
+  for (const auto &block : this->blockBindings) {
+    GLuint index = glGetUniformBlockIndex(this->id, block.first.c_str());
+    if (index != GL_INVALID_INDEX)
+      glUniformBlockBinding(this->id, index, block.second);
   }
 }
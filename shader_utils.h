@@ -1,16 +1,101 @@
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <string>
-#include <filesystem>
+#include <utility>
+#include <vector>
 #include <glad/gl.h>
 
+struct ShaderCache;
+struct ShaderCompileWorker;
+struct ShaderWatcher;
+
 struct ShaderProgram {
   GLuint id;
   std::string vertPath, fragPath;
-  // Allows automatic shader recompililation if you edit & save the .frag file
-  // while app is running
-  std::filesystem::file_time_type lastFragTime;
+  std::string compPath; // Compute programs only; vertPath/fragPath are empty
+  // Lines inserted after #version, e.g. "#define LAYERED 1\n". Part of the
+  // cache key, so each variant gets its own binary
+  std::string defines;
+
+  // Consulted by every build when set; owned by main
+  static ShaderCache *cache;
+  // Allows automatic shader recompilation if you edit & save a source file
+  // while the app is running. Set before creating programs; owned by main
+  static ShaderWatcher *watcher;
+  // Where reloads build when the driver lacks KHR_parallel_shader_compile.
+  // Without one they compile on the render thread and stall it. Set by main;
+  // must outlive every program
+  static ShaderCompileWorker *compileWorker;
 
-  ShaderProgram(const std::string &vp, const std::string &fp);
+  ShaderProgram(const std::string &vp, const std::string &fp,
+                const std::string &defines = "");
+  // Compute program. Needs a GL 4.3 context (see glCaps.computeShaders)
+  explicit ShaderProgram(const std::string &cp);
+  // Compute program with defines (a second string argument means a
+  // fragment shader to the constructor)
+  static std::unique_ptr<ShaderProgram> compute(const std::string &cp,
+                                                const std::string &defines);
   ~ShaderProgram();
+  // Call once per frame before using id. A changed source starts a
+  // background compile (driver threads, or compileWorker), and id switches
+  // to the new program on a later call once it has linked. Blocks only when
+  // neither is available, which it logs. A failed build keeps the old
+  // program
   void reloadIfChanged();
-};
\ No newline at end of file
+
+  // Uniform lookups by name happen here, once per link, never per frame.
+  // uniformHandle registers a name and returns a stable index; location()
+  // is -1 when the current program doesn't use the uniform
+  int uniformHandle(const char *name);
+  GLint location(int handle) const { return this->uniformLocations[handle]; }
+  // Integer uniforms that never change for this program, typically sampler
+  // and image units. Applied now and again after every relink
+  void setFixedUniform(const char *name, int value);
+  // Points a uniform block at a buffer binding point (see param_block.h)
+  void bindBlock(const char *name, GLuint binding);
+
+private:
+  struct ComputeTag {};
+  ShaderProgram(ComputeTag, const std::string &cp, const std::string &defines);
+
+  // A program on its way from sources to a linked program
+  struct Build {
+    GLuint program = 0;
+    GLuint shaders[2] = {0, 0};
+    int shaderCount = 0;
+    std::string cacheKey; // Empty when the cache is off
+    bool fromCache = false;
+    std::chrono::steady_clock::time_point start;
+    // Built by compileWorker: set once the link has completed there
+    bool async = false;
+    std::atomic<bool> done{false};
+  };
+  // What a build reads. Copied into worker jobs, which may outlive us
+  struct Sources {
+    std::string vertPath, fragPath, compPath, defines;
+  };
+
+  Sources sources() const;
+  // Loads from the cache, or starts compiling and linking. Touches no
+  // ShaderProgram state, so it also runs on the compile worker
+  static void beginBuild(Build &build, const Sources &sources);
+  // True once finishBuild() would not stall (always, without
+  // KHR_parallel_shader_compile)
+  bool buildReady(const Build &build) const;
+  // Returns the link status, logging errors; the program is kept either way
+  bool finishBuild(Build &build, const char *what);
+
+  // Resolves handles and reapplies fixed uniforms and block bindings for id
+  void reflect();
+
+  std::vector<std::string> uniformNames;
+  std::vector<GLint> uniformLocations; // Parallel to uniformNames
+  std::vector<std::pair<std::string, int>> fixedUniforms;
+  std::vector<std::pair<std::string, GLuint>> blockBindings;
+
+  std::shared_ptr<Build> pending; // In-flight reload, if any
+  uint64_t seenSerial = 0; // Watcher serial already accounted for
+};
@@ -0,0 +1,101 @@
+#include "shader_watcher.h"
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+// Watched files are stored by absolute path so "shaders/a.frag" and
+// "./shaders/a.frag" name the same entry
+static std::string normalizePath(const std::string &path) {
+  std::error_code ec;
+  auto absolute = std::filesystem::weakly_canonical(path, ec);
+  return ec ? path : absolute.string();
+}
+
+ShaderWatcher::~ShaderWatcher() {
+  if (this->thread.joinable()) {
+    char stop = 0;
+    if (write(this->wakeFds[1], &stop, 1) < 0)
+      std::cerr << "Shader watcher: failed to signal stop" << std::endl;
+    this->thread.join();
+  }
+  for (int fd : {this->inotifyFd, this->wakeFds[0], this->wakeFds[1]}) {
+    if (fd >= 0)
+      close(fd);
+  }
+}
+
+bool ShaderWatcher::start() {
+  this->inotifyFd = inotify_init1(IN_CLOEXEC);
+  if (this->inotifyFd < 0) {
+    std::cerr << "Shader watcher: inotify unavailable ("
+              << std::strerror(errno) << "), hot reload disabled"
+              << std::endl;
+    return false;
+  }
+  if (pipe(this->wakeFds) < 0) {
+    std::cerr << "Shader watcher: pipe failed (" << std::strerror(errno)
+              << ")" << std::endl;
+    return false;
+  }
+  this->thread = std::thread(&ShaderWatcher::run, this);
+  return true;
+}
+
+void ShaderWatcher::watch(const std::string &path) {
+  if (this->inotifyFd < 0)
+    return;
+  std::string file = normalizePath(path);
+  std::string dir = std::filesystem::path(file).parent_path().string();
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  this->lastChange.emplace(file, 0);
+  // Adding the same directory again returns the existing descriptor
+  int wd = inotify_add_watch(this->inotifyFd, dir.c_str(),
+                             IN_CLOSE_WRITE | IN_MOVED_TO);
+  if (wd < 0) {
+    std::cerr << "Shader watcher: cannot watch " << dir << " ("
+              << std::strerror(errno) << ")" << std::endl;
+    return;
+  }
+  this->directories[wd] = dir;
+}
+
+bool ShaderWatcher::changedSince(const std::string &path, uint64_t since) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  auto it = this->lastChange.find(normalizePath(path));
+  return it != this->lastChange.end() && it->second > since;
+}
+
+void ShaderWatcher::run() {
+  alignas(inotify_event) char buffer[4096];
+  pollfd fds[2] = {{this->inotifyFd, POLLIN, 0}, {this->wakeFds[0], POLLIN, 0}};
+  while (true) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (fds[1].revents)
+      break;
+
+    ssize_t length = read(this->inotifyFd, buffer, sizeof(buffer));
+    if (length <= 0)
+      continue;
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (char *p = buffer; p < buffer + length;) {
+      auto *event = reinterpret_cast<inotify_event *>(p);
+      p += sizeof(inotify_event) + event->len;
+      auto dir = this->directories.find(event->wd);
+      if (event->len == 0 || dir == this->directories.end())
+        continue;
+      auto file = this->lastChange.find(dir->second + "/" + event->name);
+      if (file == this->lastChange.end())
+        continue;
+      file->second = this->changeSerial.fetch_add(1) + 1;
+    }
+  }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Watches shader files with inotify on a background thread. Every write to a
+// watched file bumps a global serial number, so the render thread can tell
+// that nothing changed with a single atomic load and no syscalls.
+struct ShaderWatcher {
+  ShaderWatcher() = default;
+  ShaderWatcher(const ShaderWatcher &) = delete;
+  ShaderWatcher &operator=(const ShaderWatcher &) = delete;
+  ~ShaderWatcher();
+
+  // Returns false (after printing why) if inotify is unavailable
+  bool start();
+  // Safe to call from any thread. Watches the file's directory, since most
+  // editors save by writing a new file and renaming it over the old one
+  void watch(const std::string &path);
+
+  // Increases every time any watched file changes
+  uint64_t serial() const { return this->changeSerial.load(); }
+  // True if path changed after the given serial
+  bool changedSince(const std::string &path, uint64_t since);
+
+private:
+  void run();
+
+  int inotifyFd = -1;
+  int wakeFds[2] = {-1, -1}; // Pipe that stops the thread
+  std::thread thread;
+  std::atomic<uint64_t> changeSerial{0};
+
+  std::mutex mutex; // Guards the maps below
+  std::unordered_map<int, std::string> directories; // Watch descriptor -> dir
+  std::unordered_map<std::string, uint64_t> lastChange; // Path -> serial
+};
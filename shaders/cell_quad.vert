@@ -0,0 +1,36 @@
+#version 330 core
+
+// Stand-in for fullscreen_quad.vert in temporal mode, drawn with one instance
+// per grid cell. Cells the dirty mask leaves out collapse to a point, so they
+// are never rasterized and the target keeps last frame's pixels there.
+
+layout (location = 0) in vec2 a_position;
+layout (location = 1) in vec2 a_texCoord;
+
+uniform sampler2D u_dirty; // gridCols x gridRows, nonzero = recompute (change_detect.frag)
+uniform vec2 texelSize; // Of the target (set by RenderPass)
+uniform int u_flipY; // As in fullscreen_quad.vert
+uniform int u_topDown; // 1 when the target is written top-down; cells still count from the bottom of the image
+
+out vec2 v_texCoord;
+
+void main() {
+    ivec2 gridSize = textureSize(u_dirty, 0);
+    ivec2 cell = ivec2(gl_InstanceID % gridSize.x, gl_InstanceID / gridSize.x);
+    if(texelFetch(u_dirty, cell, 0).r == 0.0f) {
+        v_texCoord = vec2(0.0f);
+        gl_Position = vec4(-2.0f, -2.0f, 0.0f, 1.0f);
+        return;
+    }
+
+    // Whole pixels per cell, the way the histogram pass divides them. Pixels
+    // past the last whole cell are never redrawn
+    ivec2 targetSize = ivec2(round(1.0f / texelSize));
+    vec2 pixel = (vec2(cell) + a_texCoord) * vec2(targetSize / gridSize);
+    if(u_topDown == 1) {
+        pixel.y = float(targetSize.y) - pixel.y;
+    }
+    vec2 uv = pixel / vec2(targetSize);
+    v_texCoord = u_flipY == 1 ? vec2(uv.x, 1.0 - uv.y) : uv;
+    gl_Position = vec4(uv * 2.0f - 1.0f, 0.0f, 1.0f);
+}
@@ -0,0 +1,35 @@
+#version 330 core
+
+out vec4 fragColor;
+
+uniform sampler2D u_signature; // This frame's block means (change_signature.frag)
+uniform sampler2D u_previousSignature; // Last frame's
+layout(std140) uniform ChangeParams {
+    vec2 u_textureSize; // Input size in pixels
+    vec2 u_cellSize; // Pixels per cell, as the histogram pass counts them
+    int u_inputFormat; // 0 = RGB, 1 = NV12, 2 = I420
+    float u_tolerance; // Largest block change (8-bit levels) still "unchanged"
+    int u_reset; // 1 marks every cell dirty
+};
+
+// One fragment per grid cell: 1 if the cell has to be recomputed, else 0
+void main() {
+    if(u_reset == 1) {
+        fragColor = vec4(1.0f, 0.0f, 0.0f, 1.0f);
+        return;
+    }
+
+    ivec2 cell = ivec2(gl_FragCoord.xy);
+    ivec2 size = textureSize(u_signature, 0);
+    // The cell's 4x4 blocks and the ring of blocks around them: the Sobel
+    // kernel reads one pixel into the neighbouring cells
+    float change = 0.0f;
+    for(int j = -1; j <= 4; j++) {
+        for(int i = -1; i <= 4; i++) {
+            ivec2 block = clamp(cell * 4 + ivec2(i, j), ivec2(0), size - 1);
+            vec3 d = abs(texelFetch(u_signature, block, 0).rgb - texelFetch(u_previousSignature, block, 0).rgb);
+            change = max(change, max(d.r, max(d.g, d.b)));
+        }
+    }
+    fragColor = vec4(round(change * 255.0f) > u_tolerance ? 1.0f : 0.0f, 0.0f, 0.0f, 1.0f);
+}
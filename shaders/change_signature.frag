@@ -0,0 +1,55 @@
+#version 330 core
+
+out vec4 fragColor;
+
+uniform sampler2D u_texture; // RGB, or the Y plane for YUV input (top-down)
+uniform sampler2D u_chromaTexture; // UV plane (NV12) or U plane (I420)
+uniform sampler2D u_chromaTexture2; // V plane (I420)
+layout(std140) uniform ChangeParams {
+    vec2 u_textureSize; // Input size in pixels
+    vec2 u_cellSize; // Pixels per cell, as the histogram pass counts them
+    int u_inputFormat; // 0 = RGB, 1 = NV12, 2 = I420
+    float u_tolerance; // Largest block change (8-bit levels) still "unchanged"
+    int u_reset; // 1 marks every cell dirty
+};
+
+// Same conversion as edge_detect.frag
+vec3 yuvToRgb(float y, vec2 uv) {
+    y = 1.1643f * (y - 0.0625f);
+    uv -= vec2(0.5f);
+    return clamp(vec3(y + 1.5958f * uv.y,
+                      y - 0.39173f * uv.x - 0.81290f * uv.y,
+                      y + 2.017f * uv.x), 0.0f, 1.0f);
+}
+
+vec3 sampleInput(vec2 coord) {
+    if(u_inputFormat == 0) {
+        return texture(u_texture, coord).rgb;
+    }
+    float y = texture(u_texture, coord).r;
+    vec2 uv = u_inputFormat == 1 ? texture(u_chromaTexture, coord).rg
+                                 : vec2(texture(u_chromaTexture, coord).r, texture(u_chromaTexture2, coord).r);
+    return yuvToRgb(y, uv);
+}
+
+// Block signature of the frame: each cell split into 4x4 blocks, one texel
+// per block holding its mean colour. Averaging every pixel once is far
+// cheaper than the Sobel pass and smooths out compression noise
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    ivec2 cellSize = ivec2(u_cellSize);
+    ivec2 cellOrigin = (texel / 4) * cellSize;
+    ivec2 block = texel % 4;
+    // Cells count from the bottom of the image; input rows are top-down
+    ivec2 begin = cellOrigin + block * cellSize / 4;
+    ivec2 end = max(cellOrigin + (block + 1) * cellSize / 4, begin + 1);
+
+    vec3 sum = vec3(0.0f);
+    for(int y = begin.y; y < end.y; y++) {
+        for(int x = begin.x; x < end.x; x++) {
+            sum += sampleInput(vec2(x + 0.5f, u_textureSize.y - (y + 0.5f)) / u_textureSize);
+        }
+    }
+    ivec2 size = end - begin;
+    fragColor = vec4(sum / float(size.x * size.y), 1.0f);
+}
@@ -3,9 +3,16 @@
 in vec2 v_texCoord;
 out vec4 fragColor;
 
+#ifdef LAYERED
+flat in int v_layer;
+uniform sampler2DArray u_texture; // One batch input per layer
+#define SAMPLE(s, coord) texture(s, vec3(coord, v_layer))
+#else
 uniform sampler2D u_texture;
+#define SAMPLE(s, coord) texture(s, coord)
+#endif
 
 void main() {
-    vec3 color = texture(u_texture, v_texCoord).rgb;
+    vec3 color = SAMPLE(u_texture, v_texCoord).rgb;
     fragColor = vec4(color, 1.0);
 }
@@ -3,12 +3,52 @@
 in vec2 v_texCoord;
 out vec4 fragColor;
 
-uniform sampler2D u_texture;
-uniform vec2 u_textureSize;
-uniform float u_threshold;
+#ifdef LAYERED
+// Same planes, one batch input per layer
+flat in int v_layer;
+uniform sampler2DArray u_texture;
+uniform sampler2DArray u_chromaTexture;
+uniform sampler2DArray u_chromaTexture2;
+#define SAMPLE(s, coord) texture(s, vec3(coord, v_layer))
+#else
+uniform sampler2D u_texture; // RGB, or the Y plane for YUV input
+uniform sampler2D u_chromaTexture; // UV plane (NV12) or U plane (I420)
+uniform sampler2D u_chromaTexture2; // V plane (I420)
+#define SAMPLE(s, coord) texture(s, coord)
+#endif
+layout(std140) uniform EdgeParams {
+    vec2 u_textureSize; // Sobel taps are 1 / u_textureSize apart: one target texel
+    float u_threshold;
+    int u_inputFormat; // 0 = RGB, 1 = NV12, 2 = I420
+    // Part of u_texture the target covers: the whole input at full resolution,
+    // whole cells only when downsampled
+    vec2 u_sourceOffset;
+    vec2 u_sourceScale;
+};
+uniform int u_flipY; // 1 when u_texture rows are stored top-down
+
+// BT.601 limited range, what most SD/HD decoders hand out
+vec3 yuvToRgb(float y, vec2 uv) {
+    y = 1.1643f * (y - 0.0625f);
+    uv -= vec2(0.5f);
+    return clamp(vec3(y + 1.5958f * uv.y,
+                      y - 0.39173f * uv.x - 0.81290f * uv.y,
+                      y + 2.017f * uv.x), 0.0f, 1.0f);
+}
+
+vec3 sampleInput(vec2 coord) {
+    if(u_inputFormat == 0) {
+        return SAMPLE(u_texture, coord).rgb;
+    }
+    float y = SAMPLE(u_texture, coord).r;
+    vec2 uv = u_inputFormat == 1 ? SAMPLE(u_chromaTexture, coord).rg
+                                 : vec2(SAMPLE(u_chromaTexture, coord).r, SAMPLE(u_chromaTexture2, coord).r);
+    return yuvToRgb(y, uv);
+}
 
 void main() {
-    vec2 texelSize = 1.0f / u_textureSize;
+    // Top-down input: step rows the other way so "up" still means up in the image
+    vec2 texelSize = vec2(1.0f, u_flipY == 1 ? -1.0f : 1.0f) / u_textureSize;
 
     float kernelX[9];
     float kernelY[9];
@@ -21,10 +61,14 @@ void main() {
     kernelY[3] = 0.0f; kernelY[4] = 0.0f; kernelY[5] = 0.0f;
     kernelY[6] = 1.0f; kernelY[7] = 2.0f; kernelY[8] = 1.0f;
 
+    // Downsampled targets land between input pixels, and the bilinear taps
+    // average the pixels each texel stands for
+    vec2 coord = u_sourceOffset + v_texCoord * u_sourceScale;
+
     vec3 texColor[9];
     for(int i = -1; i <= 1; i++) {
         for(int j = -1; j <= 1; j++) {
-            texColor[(i + 1) * 3 + (j + 1)] = texture(u_texture, v_texCoord + vec2(i, j) * texelSize).rgb;
+            texColor[(i + 1) * 3 + (j + 1)] = sampleInput(coord + vec2(i, j) * texelSize);
         }
     }
 
@@ -3,9 +3,24 @@
 layout (location = 0) in vec2 a_position;
 layout (location = 1) in vec2 a_texCoord;
 
+uniform int u_flipY; // 1 when sampling a top-down texture (uploaded frames) or writing top-down output
+
 out vec2 v_texCoord;
 
+#ifdef LAYERED
+// Batches: one instance per layer of a texture array target. Without
+// VERTEX_LAYER (no gl_Layer here) RenderPass draws each layer on its own
+uniform int u_layer; // First layer of the draw
+flat out int v_layer;
+#endif
+
 void main() {
-    v_texCoord = a_texCoord;
+    v_texCoord = u_flipY == 1 ? vec2(a_texCoord.x, 1.0 - a_texCoord.y) : a_texCoord;
     gl_Position = vec4(a_position, 0.0, 1.0);
+#ifdef LAYERED
+    v_layer = u_layer + gl_InstanceID;
+#ifdef VERTEX_LAYER
+    gl_Layer = v_layer;
+#endif
+#endif
 }
@@ -0,0 +1,75 @@
+#version 330 core
+
+out vec4 fragColor;
+
+#ifdef LAYERED
+// Same inputs, one batch input per layer
+flat in int v_layer;
+uniform sampler2DArray u_cells;
+uniform sampler2DArray u_texture;
+uniform sampler2DArray u_chromaTexture;
+uniform sampler2DArray u_chromaTexture2;
+#define SAMPLE(s, coord) texture(s, vec3(coord, v_layer))
+#define FETCH(s, texel) texelFetch(s, ivec3(texel, v_layer), 0)
+#else
+uniform sampler2D u_cells; // Dominant edge direction per cell (histogram pass)
+uniform sampler2D u_texture; // RGB, or the Y plane for YUV input (top-down)
+uniform sampler2D u_chromaTexture; // UV plane (NV12) or U plane (I420)
+uniform sampler2D u_chromaTexture2; // V plane (I420)
+#define SAMPLE(s, coord) texture(s, coord)
+#define FETCH(s, texel) texelFetch(s, texel, 0)
+#endif
+layout(std140) uniform GridParams {
+    vec2 u_textureSize; // Input size in pixels
+    vec2 u_cellSize; // Pixels per cell, as the histogram pass counts them
+    int u_inputFormat; // 0 = RGB, 1 = NV12, 2 = I420
+    int u_brightnessLevels; // Glyphs before the edge glyphs
+};
+
+// Same conversion as edge_detect.frag
+vec3 yuvToRgb(float y, vec2 uv) {
+    y = 1.1643f * (y - 0.0625f);
+    uv -= vec2(0.5f);
+    return clamp(vec3(y + 1.5958f * uv.y,
+                      y - 0.39173f * uv.x - 0.81290f * uv.y,
+                      y + 2.017f * uv.x), 0.0f, 1.0f);
+}
+
+vec3 sampleInput(vec2 coord) {
+    if(u_inputFormat == 0) {
+        return SAMPLE(u_texture, coord).rgb;
+    }
+    float y = SAMPLE(u_texture, coord).r;
+    vec2 uv = u_inputFormat == 1 ? SAMPLE(u_chromaTexture, coord).rg
+                                 : vec2(SAMPLE(u_chromaTexture, coord).r, SAMPLE(u_chromaTexture2, coord).r);
+    return yuvToRgb(y, uv);
+}
+
+// One fragment per grid cell. Output: R = glyph index (brightness level, or
+// u_brightnessLevels + direction bin for edge cells), GBA = mean cell colour
+void main() {
+    ivec2 cell = ivec2(gl_FragCoord.xy);
+
+    // 4x4 bilinear taps cover the cell well enough for a colour average.
+    // Cells count from the bottom of the image; input rows are top-down
+    vec3 color = vec3(0.0f);
+    for(int i = 0; i < 4; i++) {
+        for(int j = 0; j < 4; j++) {
+            vec2 p = (vec2(cell) + (vec2(i, j) + 0.5f) / 4.0f) * u_cellSize;
+            color += sampleInput(vec2(p.x, u_textureSize.y - p.y) / u_textureSize);
+        }
+    }
+    color /= 16.0f;
+
+    int glyph;
+    float edge = FETCH(u_cells, cell).r;
+    if(edge > 0.0f) {
+        // edge_detect.frag writes 0.1 ... 0.5 and 0.7 ... 0.9 for bins 0 ... 7
+        int value = int(round(edge * 10.0f));
+        glyph = u_brightnessLevels + (value > 5 ? value - 2 : value - 1);
+    } else {
+        float brightness = dot(color, vec3(0.299f, 0.587f, 0.114f));
+        glyph = min(int(brightness * float(u_brightnessLevels)), u_brightnessLevels - 1);
+    }
+    fragColor = vec4(float(glyph) / 255.0f, color);
+}
@@ -1,21 +1,29 @@
 #version 330 core
 
+#ifdef LAYERED
+flat in int v_layer;
+uniform sampler2DArray u_image; // One batch input's edges per layer
+#define FETCH(s, texel) texelFetch(s, ivec3(texel, v_layer), 0)
+#else
 uniform sampler2D u_image;
+#define FETCH(s, texel) texelFetch(s, texel, 0)
+#endif
 
-uniform vec2 u_gridCellDimensions; // New uniform to store the dimensions of the grid (number of columns and rows)
-uniform int u_threshold;
+layout(std140) uniform HistogramParams {
+    vec2 u_gridCellDimensions; // Number of columns and rows in the grid
+    int u_threshold;
+};
 out vec4 outColor;
 
 const vec3 BLACK = vec3(0.0, 0.0, 0.0);
 
-// Increase the size of the histogram arrays to handle larger cells
-const int MAX_HISTOGRAM_SIZE = 16;
-vec3 colorHistogram[MAX_HISTOGRAM_SIZE];
-int countHistogram[MAX_HISTOGRAM_SIZE];
+// edge_detect.frag only emits these 8 values (plus black for no edge), the
+// same bins as histogram.comp
+const float BIN_VALUES[8] = float[](0.1, 0.2, 0.3, 0.4, 0.5, 0.7, 0.8, 0.9);
 
 void main() {
     vec2 bufferDimensions = u_gridCellDimensions;
-    vec2 imageDimensions = vec2(textureSize(u_image, 0));
+    vec2 imageDimensions = vec2(textureSize(u_image, 0).xy);
     vec2 gridCellDimensions = vec2(imageDimensions.x / bufferDimensions.x, imageDimensions.y / bufferDimensions.y);
 
     ivec2 coords = ivec2(gl_FragCoord.xy);
@@ -23,56 +31,38 @@ void main() {
     int gridY = coords.y;
 
     ivec2 cellOrigin = ivec2(gridX * int(gridCellDimensions.x), gridY * int(gridCellDimensions.y));
-    int histogramIndex = 0;
-    int nonBlackCount = 0;
 
-    // Initialize histograms
-    for (int i = 0; i < MAX_HISTOGRAM_SIZE; i++) {
-        colorHistogram[i] = BLACK;
-        countHistogram[i] = 0;
-    }
+    int countHistogram[8] = int[](0, 0, 0, 0, 0, 0, 0, 0);
 
-    // Iterate over the cell and populate the histograms
+    // Iterate over the cell and count each edge direction
     for (int i = 0; i < int(gridCellDimensions.x); i += 1) {
         for (int j = 0; j < int(gridCellDimensions.y); j += 1) {
             ivec2 pixelCoords = cellOrigin + ivec2(i, j);
-            vec3 color = texelFetch(u_image, pixelCoords, 0).rgb;
-
-            if (color == BLACK) continue;
-
-            nonBlackCount++;
-            bool found = false;
-            for (int k = 0; k < histogramIndex; k++) {
-                if (colorHistogram[k] == color) {
-                    countHistogram[k]++;
-                    found = true;
-                    break;
-                }
-            }
-
-            if (!found && histogramIndex < MAX_HISTOGRAM_SIZE) {
-                colorHistogram[histogramIndex] = color;
-                countHistogram[histogramIndex] = 1;
-                histogramIndex++;
-            }
+            float value = FETCH(u_image, pixelCoords).r;
+            int quantized = int(value * 10.0 + 0.5); // 1..5, 7..9; 0 is black
+            if (quantized == 0) continue;
+            countHistogram[quantized <= 5 ? quantized - 1 : quantized - 2]++;
         }
     }
 
-    vec3 mostFrequentColor = BLACK;
+    int nonBlackCount = 0;
     int highestCount = 0;
+    int mostFrequentBin = -1;
 
-    // Find the most frequent color
-    for (int k = 0; k < histogramIndex; k++) {
+    // Find the most frequent direction. Strictly greater: ties go to the
+    // lowest bin, as in histogram.comp
+    for (int k = 0; k < 8; k++) {
+        nonBlackCount += countHistogram[k];
         if (countHistogram[k] > highestCount) {
-            mostFrequentColor = colorHistogram[k];
             highestCount = countHistogram[k];
+            mostFrequentBin = k;
         }
     }
 
-    // If the number of non-black pixels is below the threshold, output black, otherwise output the most frequent color
-    if (nonBlackCount < u_threshold) {
+    // If the number of non-black pixels is below the threshold, output black, otherwise output the most frequent direction
+    if (mostFrequentBin < 0 || nonBlackCount < u_threshold) {
         outColor = vec4(BLACK, 1.0);
     } else {
-        outColor = vec4(mostFrequentColor, 1.0);
+        outColor = vec4(vec3(BIN_VALUES[mostFrequentBin]), 1.0);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Snapshot of how a queue was used, to tell which side of it is the
+// bottleneck. A queue that is usually full means the consumer is slow; one
+// that is usually empty means the producer is slow.
+struct QueueStats {
+  uint64_t pushes = 0;
+  double averageDepth = 0.0; // Sampled on every push, before the push
+  size_t maxDepth = 0;
+  size_t capacity = 0;
+  double producerBlockedSeconds = 0.0; // Waiting for room (backpressure)
+  double consumerStarvedSeconds = 0.0; // Waiting for an item
+};
+
+// Bounded lock-free single-producer/single-consumer ring buffer. push()
+// blocks while the queue is full, which is what throttles a fast producer
+// down to the speed of the stage after it.
+template <typename T> struct SpscQueue {
+  explicit SpscQueue(size_t capacity) : slots(capacity) {}
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+
+  bool tryPush(T &item) {
+    size_t h = this->head.load(std::memory_order_relaxed);
+    if (h - this->tail.load(std::memory_order_acquire) == this->slots.size())
+      return false;
+    this->slots[h % this->slots.size()] = std::move(item);
+    this->head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool tryPop(T &item) {
+    size_t t = this->tail.load(std::memory_order_relaxed);
+    if (t == this->head.load(std::memory_order_acquire))
+      return false;
+    item = std::move(this->slots[t % this->slots.size()]);
+    this->tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Blocks until there is room. Returns false if the queue was closed
+  bool push(T item) {
+    size_t depth = size();
+    this->depthSum.fetch_add(depth, std::memory_order_relaxed);
+    size_t prevMax = this->maxDepth.load(std::memory_order_relaxed);
+    while (depth > prevMax &&
+           !this->maxDepth.compare_exchange_weak(prevMax, depth,
+                                                 std::memory_order_relaxed)) {
+    }
+
+    if (!tryPush(item)) {
+      auto start = std::chrono::steady_clock::now();
+      for (int spins = 0; !tryPush(item); spins++) {
+        if (this->closed.load(std::memory_order_acquire))
+          return false;
+        backoff(spins);
+      }
+      this->producerBlockedNs.fetch_add(elapsedNs(start),
+                                        std::memory_order_relaxed);
+    }
+    this->pushes.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Blocks until an item arrives. Returns false once the queue is closed and
+  // drained
+  bool pop(T &item) {
+    if (tryPop(item))
+      return true;
+    auto start = std::chrono::steady_clock::now();
+    for (int spins = 0; !tryPop(item); spins++) {
+      if (this->closed.load(std::memory_order_acquire)) {
+        // The producer may have pushed right before closing
+        if (tryPop(item))
+          break;
+        return false;
+      }
+      backoff(spins);
+    }
+    this->consumerStarvedNs.fetch_add(elapsedNs(start),
+                                      std::memory_order_relaxed);
+    return true;
+  }
+
+  // Wakes both sides; pending items can still be popped
+  void close() { this->closed.store(true, std::memory_order_release); }
+
+  size_t size() const {
+    return this->head.load(std::memory_order_acquire) -
+           this->tail.load(std::memory_order_acquire);
+  }
+
+  QueueStats stats() const {
+    QueueStats s;
+    s.pushes = this->pushes.load(std::memory_order_relaxed);
+    s.averageDepth =
+        s.pushes ? (double)this->depthSum.load(std::memory_order_relaxed) /
+                       s.pushes
+                 : 0.0;
+    s.maxDepth = this->maxDepth.load(std::memory_order_relaxed);
+    s.capacity = this->slots.size();
+    s.producerBlockedSeconds =
+        this->producerBlockedNs.load(std::memory_order_relaxed) * 1e-9;
+    s.consumerStarvedSeconds =
+        this->consumerStarvedNs.load(std::memory_order_relaxed) * 1e-9;
+    return s;
+  }
+
+private:
+  // Spin briefly (stages usually hand over within microseconds), then yield,
+  // then sleep so a stalled stage does not burn a core
+  static void backoff(int spins) {
+    if (spins < 64)
+      return;
+    if (spins < 128)
+      std::this_thread::yield();
+    else
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+
+  static uint64_t elapsedNs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  }
+
+  std::vector<T> slots;
+  // Monotonic counters; the slot index is the counter modulo capacity.
+  // Kept on separate cache lines so producer and consumer don't false-share
+  alignas(64) std::atomic<size_t> head{0}; // Written by the producer only
+  alignas(64) std::atomic<size_t> tail{0}; // Written by the consumer only
+  alignas(64) std::atomic<bool> closed{false};
+
+  std::atomic<uint64_t> pushes{0}, depthSum{0};
+  std::atomic<size_t> maxDepth{0};
+  std::atomic<uint64_t> producerBlockedNs{0}, consumerStarvedNs{0};
+};
@@ -0,0 +1,70 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int threads) {
+  if (threads <= 0)
+    threads = (int)std::max(1u, std::thread::hardware_concurrency());
+  for (int i = 1; i < threads; i++)
+    this->threads.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stopping = true;
+  }
+  this->wake.notify_all();
+  for (std::thread &t : this->threads)
+    t.join();
+}
+
+void ThreadPool::runIndices(int worker) {
+  for (int i = this->nextIndex.fetch_add(1); i < this->jobCount;
+       i = this->nextIndex.fetch_add(1))
+    (*this->job)(i, worker);
+}
+
+void ThreadPool::workerLoop(int worker) {
+  uint64_t seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(this->mutex);
+      this->wake.wait(lock, [&] {
+        return this->stopping || this->generation != seen;
+      });
+      if (this->stopping)
+        return;
+      seen = this->generation;
+    }
+    runIndices(worker);
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->busyWorkers--;
+    }
+    this->finished.notify_one();
+  }
+}
+
+void ThreadPool::parallelFor(int count,
+                             const std::function<void(int, int)> &fn) {
+  if (this->threads.empty() || count <= 1) {
+    for (int i = 0; i < count; i++)
+      fn(i, 0);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->job = &fn;
+    this->jobCount = count;
+    this->nextIndex = 0;
+    this->busyWorkers = (int)this->threads.size();
+    this->generation++;
+  }
+  this->wake.notify_all();
+  runIndices(0);
+
+  // Every worker checks in, even those that found no work left, so none can
+  // still be touching fn after we return
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->finished.wait(lock, [&] { return this->busyWorkers == 0; });
+  this->job = nullptr;
+}
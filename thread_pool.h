@@ -0,0 +1,39 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops. The calling thread
+// takes part in every loop, so a pool of size 1 has no extra threads at all.
+struct ThreadPool {
+  // threads <= 0 means one per hardware thread
+  explicit ThreadPool(int threads = 0);
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ~ThreadPool();
+
+  // Workers including the caller
+  int size() const { return (int)this->threads.size() + 1; }
+  // Calls fn(index, worker) for every index in [0, count), spread over the
+  // workers, and returns once all calls have finished. worker is in
+  // [0, size()) and unique among concurrent calls, for per-worker scratch
+  void parallelFor(int count, const std::function<void(int, int)> &fn);
+
+private:
+  void workerLoop(int worker);
+  void runIndices(int worker);
+
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable wake, finished;
+  const std::function<void(int, int)> *job = nullptr;
+  int jobCount = 0;
+  std::atomic<int> nextIndex{0};
+  int busyWorkers = 0;     // Workers yet to finish the current job
+  uint64_t generation = 0; // Bumped for every job
+  bool stopping = false;
+};
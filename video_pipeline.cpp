@@ -0,0 +1,459 @@
+#include "video_pipeline.h"
+#include "frame_upload.h"
+#include "pipeline.h"
+#include "profiler.h"
+#include "readback.h"
+#include "shader_cache.h"
+#include "shader_utils.h"
+#include "spsc_queue.h"
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+bool isVideoFile(const std::string &path) {
+  std::string ext = std::filesystem::path(path).extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  static const char *videoExtensions[] = {".mp4", ".mov", ".mkv", ".avi",
+                                          ".webm", ".m4v", ".mpg", ".mpeg"};
+  for (const char *v : videoExtensions) {
+    if (ext == v)
+      return true;
+  }
+  return false;
+}
+
+static void printQueueStats(const char *name, const QueueStats &s) {
+  std::cout << "  " << name << " queue: avg depth " << std::fixed
+            << std::setprecision(2) << s.averageDepth << "/" << s.capacity
+            << ", max " << s.maxDepth << ", producer blocked "
+            << s.producerBlockedSeconds << " s, consumer starved "
+            << s.consumerStarvedSeconds << " s" << std::defaultfloat
+            << std::endl;
+}
+
+static void printVideoSummary(const std::string &inputPath, int frames,
+                              double seconds, const QueueStats &decodeStats,
+                              const QueueStats &encodeStats) {
+  std::cout << "Processed " << frames << " frame(s) of " << inputPath
+            << " in " << seconds << " s ("
+            << (seconds > 0 ? frames / seconds : 0.0) << " fps)" << std::endl;
+  printQueueStats("decode -> render", decodeStats);
+  printQueueStats("render -> encode", encodeStats);
+
+  // Time each stage spent doing work rather than waiting on a queue; the
+  // busiest stage bounds throughput
+  double decodeBusy = seconds - decodeStats.producerBlockedSeconds;
+  double renderBusy = seconds - decodeStats.consumerStarvedSeconds -
+                      encodeStats.producerBlockedSeconds;
+  double encodeBusy = seconds - encodeStats.consumerStarvedSeconds;
+  const char *bottleneck = "decode";
+  if (renderBusy >= decodeBusy && renderBusy >= encodeBusy)
+    bottleneck = "render";
+  else if (encodeBusy >= decodeBusy)
+    bottleneck = "encode";
+  std::cout << "  Bottleneck: " << bottleneck << std::endl;
+}
+
+// read() returns false both at the end of the stream and on a decode error.
+// Stopping short of the frame count the container reports is the latter
+static bool decodedAll(const cv::VideoCapture &capture, int frames,
+                       const std::string &inputPath) {
+  int expected = (int)capture.get(cv::CAP_PROP_FRAME_COUNT);
+  if (expected <= 0 || frames >= expected)
+    return true;
+  std::cerr << "Decoding " << inputPath << " stopped after " << frames
+            << " of " << expected << " frames" << std::endl;
+  return false;
+}
+
+// NV12 and I420 frames have the same shape, so only the decoder can tell
+// them apart. fourcc is what the backend reports as the codec's pixel format
+// (FFmpeg's raw tags)
+static bool codecFormatIs(int fourcc, PixelFormat format) {
+  if (format == PixelFormat::NV12)
+    return fourcc == cv::VideoWriter::fourcc('N', 'V', '1', '2');
+  return fourcc == cv::VideoWriter::fourcc('I', '4', '2', '0') ||
+         fourcc == cv::VideoWriter::fourcc('I', 'Y', 'U', 'V');
+}
+
+static std::string fourccName(int fourcc) {
+  std::string name;
+  for (int i = 0; i < 4; i++) {
+    char c = (char)((fourcc >> (8 * i)) & 0xff);
+    name += std::isprint((unsigned char)c) ? c : '?';
+  }
+  return name;
+}
+
+PipelineOutput headlessOutput(const Options &opts) {
+  if (opts.gridFormat == GridFormat::None)
+    return opts.ascii ? PipelineOutput::Ascii : PipelineOutput::Composite;
+  return opts.gridColor ? PipelineOutput::ColorGrid : PipelineOutput::Grid;
+}
+
+int processVideo(const std::string &inputPath, const std::string &outputPath,
+                 const Options &opts, GridWriter *grid) {
+  cv::VideoCapture capture(inputPath);
+  if (!capture.isOpened()) {
+    std::cerr << "Failed to open input video: " << inputPath << std::endl;
+    return -1;
+  }
+  int width = (int)capture.get(cv::CAP_PROP_FRAME_WIDTH);
+  int height = (int)capture.get(cv::CAP_PROP_FRAME_HEIGHT);
+  double fps = capture.get(cv::CAP_PROP_FPS);
+  if (fps <= 0)
+    fps = 30.0; // Some containers don't report a rate
+  if (width <= 0 || height <= 0) {
+    std::cerr << "Input video has no frame size: " << inputPath << std::endl;
+    return -1;
+  }
+
+  cv::VideoWriter writer;
+  if (!grid &&
+      !writer.open(outputPath, cv::VideoWriter::fourcc('m', 'p', '4', 'v'),
+                   fps, cv::Size(width, height))) {
+    std::cerr << "Failed to open output video: " << outputPath << std::endl;
+    return -1;
+  }
+
+  // Raw YUV only comes out of backends that support it; probe the first frame
+  // and fall back to BGR if the decoder converted anyway
+  PixelFormat format = PixelFormat::BGR;
+  cv::Mat probe;
+  bool wantYuv = opts.inputFormat != PixelFormat::BGR;
+  if (wantYuv && !yuvUploadSupported(width, height)) {
+    std::cerr << "Odd frame size " << width << "x" << height
+              << " has no raw YUV layout, using BGR" << std::endl;
+    wantYuv = false;
+  }
+  if (wantYuv) {
+    capture.set(cv::CAP_PROP_CONVERT_RGB, 0);
+    if (!capture.read(probe)) {
+      std::cerr << "Input video has no frames: " << inputPath << std::endl;
+      return -1;
+    }
+    const char *requested =
+        opts.inputFormat == PixelFormat::NV12 ? "nv12" : "i420";
+    int codecFormat = (int)capture.get(cv::CAP_PROP_CODEC_PIXEL_FORMAT);
+    if (probe.type() != CV_8UC1 || probe.cols != width ||
+        probe.rows != height * 3 / 2) {
+      std::cerr << "Decoder does not output raw YUV, using BGR" << std::endl;
+    } else if (codecFormat == 0) {
+      std::cerr << "Decoder does not report its pixel format, assuming "
+                << requested << std::endl;
+      format = opts.inputFormat;
+    } else if (!codecFormatIs(codecFormat, opts.inputFormat)) {
+      std::cerr << "Decoder outputs " << fourccName(codecFormat) << ", not "
+                << requested << ", using BGR" << std::endl;
+      // The probe is in the decoder's layout; start over with conversion
+      probe = cv::Mat();
+      if (!capture.open(inputPath)) {
+        std::cerr << "Failed to reopen input video: " << inputPath
+                  << std::endl;
+        return -1;
+      }
+      capture.set(cv::CAP_PROP_CONVERT_RGB, 1);
+    } else {
+      format = opts.inputFormat;
+    }
+  }
+
+  // Slots for every queued frame, plus one being decoded and one uploading
+  int slotCount = opts.queueDepth + 2;
+  FrameUploader uploader;
+  uploader.init(width, height, format, slotCount);
+  // Header over a slot so the decoder writes straight into upload memory
+  auto slotMat = [&](int slot) {
+    return format == PixelFormat::BGR
+               ? cv::Mat(height, width, CV_8UC3, uploader.slotData(slot))
+               : cv::Mat(height * 3 / 2, width, CV_8UC1,
+                         uploader.slotData(slot));
+  };
+
+  // The readback ring is sized for the first grid, so grid outputs keep
+  // their column count
+  QualityGovernor governor;
+  if (opts.targetFps > 0.0)
+    governor.targetMs = 1000.0 / opts.targetFps;
+  governor.init(width, height, grid ? opts.gridCols : opts.minGridCols,
+                opts.gridCols, opts.quality);
+
+  Pipeline pipeline;
+  pipeline.glyphStyle = opts.glyphStyle;
+  pipeline.temporal = opts.temporal;
+  pipeline.changeTolerance = opts.changeTolerance;
+  pipeline.edgeDownsample = governor.current().edgeDownsample;
+  pipeline.init(width, height, governor.current().gridCols, opts.shaderDir,
+                opts.allowCompute, headlessOutput(opts));
+  if (ShaderProgram::cache)
+    ShaderProgram::cache->printStats();
+  if (grid)
+    grid->setGlyphs(pipeline.atlas.glyphs);
+  ReadbackRing readback;
+  readback.init(pipeline.output().width, pipeline.output().height, 3,
+                pipeline.readbackFormat());
+
+  // Slots circulate: free -> decoder fills -> decoded -> render stage uploads
+  // -> back to free once the GPU has copied them out
+  SpscQueue<int> freeSlots(slotCount);
+  SpscQueue<int> decoded(opts.queueDepth);
+  SpscQueue<cv::Mat> rendered(opts.queueDepth);
+  for (int i = 0; i < slotCount; i++) {
+    int slot = i;
+    freeSlots.tryPush(slot);
+  }
+  if (!probe.empty()) {
+    int slot = 0;
+    freeSlots.tryPop(slot);
+    cv::Mat target = slotMat(slot);
+    probe.copyTo(target);
+    decoded.tryPush(slot);
+  }
+
+  using Clock = std::chrono::steady_clock;
+  auto start = Clock::now();
+
+  // Set by the decoder when the stream breaks off; the output is truncated
+  std::atomic<bool> decodeFailed{false};
+  std::thread decodeThread([&] {
+    int slot;
+    int frames = probe.empty() ? 0 : 1;
+    while (freeSlots.pop(slot)) {
+      cv::Mat frame = slotMat(slot);
+      uint8_t *slotData = frame.data;
+      {
+        ProfileSpan span("decode");
+        if (!capture.read(frame)) {
+          decodeFailed = !decodedAll(capture, frames, inputPath);
+          break;
+        }
+      }
+      frames++;
+      // The decoder reallocates if the frame doesn't match the slot layout
+      if (frame.data != slotData) {
+        if (frame.total() * frame.elemSize() != uploader.frameBytes()) {
+          std::cerr << "Decoded frame does not match the video size"
+                    << std::endl;
+          decodeFailed = true;
+          break;
+        }
+        cv::Mat target = slotMat(slot);
+        frame.copyTo(target);
+      }
+      // Downstream stopped (e.g. encoder failure): nothing left to feed
+      if (!decoded.push(slot))
+        break;
+    }
+    decoded.close();
+  });
+
+  std::atomic<int> encodedFrames{0};
+  std::thread encodeThread([&] {
+    cv::Mat frame;
+    while (rendered.pop(frame)) {
+      {
+        ProfileSpan span("encode");
+        if (grid)
+          grid->write(frame.data, frame.cols, frame.rows, frame.channels());
+        else
+          writer.write(frame);
+      }
+      encodedFrames++;
+    }
+    writer.release();
+  });
+
+  // Render stage: runs here because it owns the GL context
+  bool ok = true;
+  auto forward = [&](bool wait) {
+    cv::Mat result;
+    int tag;
+    while (readback.dequeue(result, tag, wait)) {
+      // A lost frame would leave a gap in the output
+      if (result.empty() || !rendered.push(std::move(result))) {
+        ok = false;
+        return;
+      }
+    }
+  };
+  std::deque<int> inFlight; // Uploaded slots the GPU may still be reading
+  auto recycle = [&](bool waitOldest) {
+    while (!inFlight.empty() && uploader.slotFree(inFlight.front(), waitOldest)) {
+      int slot = inFlight.front();
+      inFlight.pop_front();
+      freeSlots.tryPush(slot); // Never full: it has room for every slot
+      waitOldest = false;
+    }
+  };
+
+  int slot;
+  int frameIndex = 0;
+  while (ok) {
+    // If the decoder is starved it may be waiting for one of our slots
+    if (decoded.size() == 0)
+      recycle(true);
+    if (!decoded.pop(slot))
+      break;
+    uploader.upload(slot);
+    inFlight.push_back(slot);
+    QualityLevel level;
+    if (governor.update(level))
+      pipeline.setQuality(level.edgeDownsample, level.gridCols);
+    governor.beginFrame();
+    pipeline.run(uploader);
+    governor.endFrame();
+
+    if (readback.full())
+      forward(true);
+    if (!ok || !readback.enqueue(pipeline.output().fbo, frameIndex++)) {
+      ok = false;
+      break;
+    }
+    forward(false);
+    recycle(false);
+    if (Profiler::active)
+      Profiler::active->endFrame();
+  }
+  if (ok)
+    forward(true);
+  rendered.close();
+  // Stops the decoder if we bailed out early
+  decoded.close();
+  freeSlots.close();
+
+  decodeThread.join();
+  encodeThread.join();
+
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  printVideoSummary(inputPath, encodedFrames, seconds, decoded.stats(),
+                    rendered.stats());
+  if (decodeFailed)
+    return -1;
+  return ok && encodedFrames == frameIndex ? encodedFrames.load() : -1;
+}
+
+int processVideoCpu(const std::string &inputPath,
+                    const std::string &outputPath, const Options &opts,
+                    CpuEngine &engine, GridWriter *grid) {
+  cv::VideoCapture capture(inputPath);
+  if (!capture.isOpened()) {
+    std::cerr << "Failed to open input video: " << inputPath << std::endl;
+    return -1;
+  }
+  int width = (int)capture.get(cv::CAP_PROP_FRAME_WIDTH);
+  int height = (int)capture.get(cv::CAP_PROP_FRAME_HEIGHT);
+  double fps = capture.get(cv::CAP_PROP_FPS);
+  if (fps <= 0)
+    fps = 30.0;
+  if (width <= 0 || height <= 0) {
+    std::cerr << "Input video has no frame size: " << inputPath << std::endl;
+    return -1;
+  }
+
+  cv::VideoWriter writer;
+  if (!grid &&
+      !writer.open(outputPath, cv::VideoWriter::fourcc('m', 'p', '4', 'v'),
+                   fps, cv::Size(width, height))) {
+    std::cerr << "Failed to open output video: " << outputPath << std::endl;
+    return -1;
+  }
+  if (opts.inputFormat != PixelFormat::BGR)
+    std::cerr << "CPU engine decodes to BGR, ignoring --input-format"
+              << std::endl;
+  engine.resize(width, height, opts.gridCols);
+  // Before the encode thread starts reading the glyph table
+  if ((grid || opts.ascii) && !engine.prepareAtlas())
+    return -1;
+  if (grid)
+    grid->setGlyphs(engine.atlas.glyphs);
+
+  // Same stage layout as processVideo. The engine already spreads each
+  // frame over every core, so the render stage stays a single thread
+  SpscQueue<cv::Mat> decoded(opts.queueDepth);
+  SpscQueue<cv::Mat> rendered(opts.queueDepth);
+
+  using Clock = std::chrono::steady_clock;
+  auto start = Clock::now();
+
+  std::atomic<bool> decodeFailed{false};
+  std::thread decodeThread([&] {
+    int frames = 0;
+    while (true) {
+      cv::Mat frame;
+      {
+        ProfileSpan span("decode");
+        if (!capture.read(frame)) {
+          decodeFailed = !decodedAll(capture, frames, inputPath);
+          break;
+        }
+      }
+      frames++;
+      if (!decoded.push(std::move(frame)))
+        break;
+    }
+    decoded.close();
+  });
+
+  std::atomic<int> encodedFrames{0};
+  std::thread encodeThread([&] {
+    cv::Mat frame;
+    while (rendered.pop(frame)) {
+      {
+        ProfileSpan span("encode");
+        if (grid)
+          grid->write(frame.data, frame.cols, frame.rows, frame.channels());
+        else
+          writer.write(frame);
+      }
+      encodedFrames++;
+    }
+    writer.release();
+  });
+
+  bool ok = true;
+  int frameIndex = 0;
+  cv::Mat frame;
+  while (decoded.pop(frame)) {
+    if (frame.cols != width || frame.rows != height ||
+        frame.type() != CV_8UC3) {
+      std::cerr << "Decoded frame does not match the video size" << std::endl;
+      ok = false;
+      break;
+    }
+    cv::Mat result;
+    if (grid)
+      engine.runGrid(frame, result, opts.gridColor);
+    else if (opts.ascii)
+      engine.runAscii(frame, result);
+    else
+      engine.run(frame, result);
+    frameIndex++;
+    if (!rendered.push(std::move(result))) {
+      ok = false;
+      break;
+    }
+    if (Profiler::active)
+      Profiler::active->endFrame();
+  }
+  rendered.close();
+  decoded.close();
+
+  decodeThread.join();
+  encodeThread.join();
+
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  printVideoSummary(inputPath, encodedFrames, seconds, decoded.stats(),
+                    rendered.stats());
+  if (decodeFailed)
+    return -1;
+  return ok && encodedFrames == frameIndex ? encodedFrames.load() : -1;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "cpu_engine.h"
+#include "grid_output.h"
+#include "options.h"
+#include "pipeline.h"
+#include <string>
+
+bool isVideoFile(const std::string &path);
+// What headless runs read back: the composite or ASCII image, or the grid
+// when opts asks for grid output
+PipelineOutput headlessOutput(const Options &opts);
+
+// Decodes, renders and re-encodes a whole video. Decode and encode each get
+// their own thread; rendering stays on the calling thread, which must own a
+// current GL context. Stages are linked by bounded SPSC queues so they overlap
+// and throughput tracks the slowest stage rather than the sum of all three.
+// Returns the number of frames written, or -1 on failure. With a grid writer,
+// frames go to it instead of outputPath and only the grid is read back.
+int processVideo(const std::string &inputPath, const std::string &outputPath,
+                 const Options &opts, GridWriter *grid = nullptr);
+
+// processVideo on the CPU engine: same decode/render/encode stages, no GL
+// context needed. Always decodes to BGR.
+int processVideoCpu(const std::string &inputPath,
+                    const std::string &outputPath, const Options &opts,
+                    CpuEngine &engine, GridWriter *grid = nullptr);